@@ -0,0 +1,140 @@
+/* batch.c
+ * This file is part of the blurhash distribution (https://github.com/fumiama/blurhash).
+ * Copyright (c) 2018 Wolt Enterprises and Copyright (c) 2025 Fumiama Minamoto.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <pthread.h>
+#include <stb/stb_image.h>
+#include <stdatomic.h>
+#include <unistd.h>
+
+#include "blurhash.h"
+#include "common.h"
+
+// batchQueue: the contiguous slice of items a worker starts with.
+// The owner and any idle thief both take items through next, so no item is taken twice.
+struct batchQueue {
+	_Alignas(64) atomic_size_t next;
+	size_t end;
+};
+
+struct batchWorker {
+	int id, nworkers;
+	int xComponents, yComponents;
+	blurhash_batch_item_t *items;
+	struct batchQueue *queues;
+};
+
+static void encodeItem(int xComponents, int yComponents, blurhash_batch_item_t *item, blurhash_scratch_t *scratch) {
+	uint64_t start = blurhash_stats_begin(blurhash_stats_op_encode);
+	if(!item->filename) {
+		item->err = blurhash_encode_scratch(xComponents, yComponents, item->width, item->height,
+			blurhash_format_rgb8, item->rgb, (size_t)item->width * 3, item->hash, scratch);
+		blurhash_stats_end(start, (uint64_t)item->width * item->height, (uint64_t)item->width * item->height * 3, item->err);
+		return;
+	}
+
+	int width, height;
+	uint64_t load = blurhash_stats_clock();
+	unsigned char *data = blurhash_load_file(item->filename, &width, &height);
+	blurhash_stats_stage(blurhash_stats_stage_load, load);
+	if(!data) {
+		item->err = blurhash_stats_end(start, 0, 0, blurhash_error_stbi_load);
+		return;
+	}
+	item->err = blurhash_encode_scratch(xComponents, yComponents, width, height,
+		blurhash_format_rgb8, data, (size_t)width * 3, item->hash, scratch);
+	stbi_image_free(data);
+	blurhash_stats_end(start, (uint64_t)width * height, (uint64_t)width * height * 3, item->err);
+}
+
+// takeItem: pops the next item of queue, or returns false if it is drained
+static inline bool takeItem(struct batchQueue *queue, size_t *index) {
+	if(atomic_load_explicit(&queue->next, memory_order_relaxed) >= queue->end) return false;
+	*index = atomic_fetch_add_explicit(&queue->next, 1, memory_order_relaxed);
+	return *index < queue->end;
+}
+
+static void *batchWorkerThread(void *arg) {
+	struct batchWorker *worker = (struct batchWorker *)arg;
+	blurhash_scratch_t scratch = {NULL, 0};
+	size_t index;
+
+	for(;;) {
+		if(takeItem(&worker->queues[worker->id], &index)) {
+			encodeItem(worker->xComponents, worker->yComponents, &worker->items[index], &scratch);
+			continue;
+		}
+		// own slice drained: steal from the others, starting with the next worker
+		bool stolen = false;
+		for(int k = 1; k < worker->nworkers && !stolen; k++) {
+			stolen = takeItem(&worker->queues[(worker->id + k) % worker->nworkers], &index);
+		}
+		if(!stolen) break;
+		encodeItem(worker->xComponents, worker->yComponents, &worker->items[index], &scratch);
+	}
+
+	free(scratch.data);
+	return NULL;
+}
+
+blurhash_error_t blurhash_encode_batch(int xComponents, int yComponents, blurhash_batch_item_t *items, size_t n, int nthreads) {
+	blurhash_error_t err = blurhash_checkComponents(xComponents, yComponents);
+	if(err) return err;
+	if(!n) return blurhash_error_ok;
+
+	if(nthreads <= 0) nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+	if(nthreads < 1) nthreads = 1;
+	if((size_t)nthreads > n) nthreads = n;
+
+	struct batchQueue *queues = aligned_alloc(_Alignof(struct batchQueue), sizeof(struct batchQueue) * nthreads);
+	struct batchWorker *workers = malloc(sizeof(struct batchWorker) * nthreads);
+	pthread_t *threads = malloc(sizeof(pthread_t) * nthreads);
+	bool *started = calloc(nthreads, sizeof(bool));
+	if(!queues || !workers || !threads || !started) {
+		free(queues); free(workers); free(threads); free(started);
+		return blurhash_error_malloc;
+	}
+
+	for(int t = 0; t < nthreads; t++) {
+		atomic_init(&queues[t].next, n * t / nthreads);
+		queues[t].end = n * (t + 1) / nthreads;
+		workers[t].id = t;
+		workers[t].nworkers = nthreads;
+		workers[t].xComponents = xComponents;
+		workers[t].yComponents = yComponents;
+		workers[t].items = items;
+		workers[t].queues = queues;
+	}
+
+	// worker 0 is the calling thread; slices of workers that failed to start are stolen by the others
+	for(int t = 1; t < nthreads; t++) {
+		started[t] = pthread_create(&threads[t], NULL, batchWorkerThread, &workers[t]) == 0;
+	}
+	batchWorkerThread(&workers[0]);
+	for(int t = 1; t < nthreads; t++) {
+		if(started[t]) pthread_join(threads[t], NULL);
+	}
+
+	free(queues); free(workers); free(threads); free(started);
+
+	return blurhash_error_ok;
+}
@@ -0,0 +1,729 @@
+/* bench.c
+ * This file is part of the blurhash distribution (https://github.com/fumiama/blurhash).
+ * Copyright (c) 2018 Wolt Enterprises and Copyright (c) 2025 Fumiama Minamoto.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+// blurhash_bench: throughput of every encode and decode engine over synthetic images,
+// printed as JSON, and with --check a comparison of every engine against a plain
+// implementation of the reference algorithm.
+
+#include <limits.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "blurhash.h"
+#include "common.h"
+
+// allocation counting, enabled by linking with --wrap for the allocation functions
+#ifdef BLURHASH_BENCH_WRAP_MALLOC
+static atomic_long allocs;
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t count, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+void *__real_aligned_alloc(size_t alignment, size_t size);
+void *__wrap_malloc(size_t size) { atomic_fetch_add(&allocs, 1); return __real_malloc(size); }
+void *__wrap_calloc(size_t count, size_t size) { atomic_fetch_add(&allocs, 1); return __real_calloc(count, size); }
+void *__wrap_realloc(void *ptr, size_t size) { atomic_fetch_add(&allocs, 1); return __real_realloc(ptr, size); }
+void *__wrap_aligned_alloc(size_t alignment, size_t size) { atomic_fetch_add(&allocs, 1); return __real_aligned_alloc(alignment, size); }
+static long allocations(void) { return atomic_load(&allocs); }
+#else
+static long allocations(void) { return -1; }
+#endif
+
+static uint64_t nowNs(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// random: xorshift64*, so every run sees the same images
+static uint64_t randomState = 0x9E3779B97F4A7C15ULL;
+static uint32_t random32(void) {
+	randomState ^= randomState >> 12;
+	randomState ^= randomState << 25;
+	randomState ^= randomState >> 27;
+	return (randomState * 0x2545F4914F6CDD1DULL) >> 32;
+}
+
+static const char *patterns[] = {"gradient", "noise", "photo"};
+#define PATTERN_COUNT 3
+
+// fillPattern: a width x height rgb image of pattern
+static void fillPattern(int pattern, int width, int height, uint8_t *rgb) {
+	randomState = 0x9E3779B97F4A7C15ULL + pattern;
+	// photo: a sky-to-ground gradient with a few soft blobs and some grain
+	float blobs[4][6];
+	for(int k = 0; k < 4; k++) {
+		blobs[k][0] = random32() % 1000 / 1000.0f;
+		blobs[k][1] = random32() % 1000 / 1000.0f;
+		blobs[k][2] = 0.05f + random32() % 1000 / 5000.0f;
+		for(int c = 0; c < 3; c++) blobs[k][3 + c] = (int)(random32() % 256) - 128;
+	}
+	for(int y = 0; y < height; y++) {
+		float v = height > 1 ? (float)y / (height - 1) : 0;
+		for(int x = 0; x < width; x++) {
+			float u = width > 1 ? (float)x / (width - 1) : 0;
+			uint8_t *px = rgb + ((size_t)y * width + x) * 3;
+			if(pattern == 0) {
+				px[0] = 255 * u;
+				px[1] = 255 * v;
+				px[2] = 255 * (1 - u) * (1 - v);
+				continue;
+			}
+			uint32_t noise = random32();
+			if(pattern == 1) {
+				px[0] = noise;
+				px[1] = noise >> 8;
+				px[2] = noise >> 16;
+				continue;
+			}
+			float color[3] = {90 + 100 * v, 140 + 60 * v, 230 - 150 * v};
+			for(int k = 0; k < 4; k++) {
+				float du = u - blobs[k][0], dv = v - blobs[k][1];
+				float weight = expf(-(du * du + dv * dv) / (blobs[k][2] * blobs[k][2]));
+				for(int c = 0; c < 3; c++) color[c] += weight * blobs[k][3 + c];
+			}
+			for(int c = 0; c < 3; c++) {
+				float value = color[c] + (int)(noise >> (8 * c) & 15) - 8;
+				px[c] = value < 0 ? 0 : value > 255 ? 255 : value;
+			}
+		}
+	}
+}
+
+// encode engines, each producing hashesPerCall hashes of the same image per call
+
+static blurhash_error_t encodeExact(int xComponents, int yComponents, int width, int height, const uint8_t *rgb, char *hash) {
+	return blurhash_encode(xComponents, yComponents, width, height, rgb, hash);
+}
+
+static blurhash_error_t encodeMt(int xComponents, int yComponents, int width, int height, const uint8_t *rgb, char *hash) {
+	return blurhash_encode_mt(xComponents, yComponents, width, height, rgb, hash, 0);
+}
+
+static blurhash_error_t encodeFast(int xComponents, int yComponents, int width, int height, const uint8_t *rgb, char *hash) {
+	return blurhash_encode_fast(xComponents, yComponents, width, height, rgb, hash);
+}
+
+static blurhash_error_t encodeIncremental(int xComponents, int yComponents, int width, int height, const uint8_t *rgb, char *hash) {
+	blurhash_encoder_t *encoder;
+	blurhash_error_t err = blurhash_encoder_begin(&encoder, xComponents, yComponents, width, height);
+	if(err) return err;
+	for(int y = 0; y < height; y += 16) {
+		err = blurhash_encoder_push_rows(encoder, rgb + (size_t)y * width * 3, height - y < 16 ? height - y : 16, (size_t)width * 3);
+		if(err) {
+			blurhash_encoder_free(encoder);
+			return err;
+		}
+	}
+	return blurhash_encoder_finish(encoder, hash);
+}
+
+// benchCtx: the one context of the ctx engines, kept across calls as a caller would
+static blurhash_ctx_t *benchCtx;
+
+static blurhash_error_t encodeCtx(int xComponents, int yComponents, int width, int height, const uint8_t *rgb, char *hash) {
+	if(!benchCtx && blurhash_ctx_create(&benchCtx)) return blurhash_error_malloc;
+	return blurhash_encode_ctx(benchCtx, xComponents, yComponents, width, height, blurhash_format_rgb8, rgb, (size_t)width * 3, hash);
+}
+
+#define BATCH_ITEMS 16
+
+static blurhash_error_t encodeBatch(int xComponents, int yComponents, int width, int height, const uint8_t *rgb, char *hash) {
+	blurhash_batch_item_t items[BATCH_ITEMS];
+	for(int i = 0; i < BATCH_ITEMS; i++) {
+		items[i].filename = NULL;
+		items[i].rgb = rgb;
+		items[i].width = width;
+		items[i].height = height;
+	}
+	blurhash_error_t err = blurhash_encode_batch(xComponents, yComponents, items, BATCH_ITEMS, 0);
+	if(err) return err;
+	for(int i = 0; i < BATCH_ITEMS; i++) {
+		if(items[i].err) return items[i].err;
+		if(strcmp(items[i].hash, items[0].hash)) return blurhash_error_invalid_hash;
+	}
+	strcpy(hash, items[0].hash);
+	return blurhash_error_ok;
+}
+
+// encodeRGBA: blurhash_encode_ex on a padded rgba copy of the image
+static blurhash_error_t encodeRGBA(int xComponents, int yComponents, int width, int height, const uint8_t *rgb, char *hash) {
+	size_t bytesPerRow = (size_t)width * 4 + 12;
+	uint8_t *rgba = malloc(bytesPerRow * height);
+	if(!rgba) return blurhash_error_malloc;
+	for(int y = 0; y < height; y++) {
+		for(int x = 0; x < width; x++) {
+			memcpy(rgba + y * bytesPerRow + x * 4, rgb + ((size_t)y * width + x) * 3, 3);
+			rgba[y * bytesPerRow + x * 4 + 3] = 255;
+		}
+	}
+	blurhash_error_t err = blurhash_encode_ex(xComponents, yComponents, width, height, blurhash_format_rgba8, rgba, bytesPerRow, hash);
+	free(rgba);
+	return err;
+}
+
+struct encodeEngine {
+	const char *name;
+	blurhash_error_t (*encode)(int xComponents, int yComponents, int width, int height, const uint8_t *rgb, char *hash);
+	int hashesPerCall;
+	// reach: how far from a pixel, in pixels along x and y, the engine may take its basis, see encodeWithin; NULL is exact
+	void (*reach)(int width, int height, float reach[2]);
+	bool timed; // false for engines that only exist for --check
+};
+
+// fastEncodeReach: half the widest cell of blurhash_encode_fast, which takes the basis of a cell at its centre
+static void fastEncodeReach(int width, int height, float reach[2]) {
+	int longSide = width > height ? width : height;
+	reach[0] = reach[1] = 0;
+	if(longSide <= BLURHASH_FAST_GRID) return; // encoded by blurhash_encode
+	int gridWidth = (int)((int64_t)width * BLURHASH_FAST_GRID / longSide), gridHeight = (int)((int64_t)height * BLURHASH_FAST_GRID / longSide);
+	if(gridWidth < 1) gridWidth = 1;
+	if(gridHeight < 1) gridHeight = 1;
+	reach[0] = ((width + gridWidth - 1) / gridWidth - 1) / 2.0f;
+	reach[1] = ((height + gridHeight - 1) / gridHeight - 1) / 2.0f;
+}
+
+static const struct encodeEngine encodeEngines[] = {
+	{"exact", encodeExact, 1, NULL, true},
+	{"mt", encodeMt, 1, NULL, true},
+	{"fast", encodeFast, 1, fastEncodeReach, true},
+	{"incremental", encodeIncremental, 1, NULL, true},
+	{"batch", encodeBatch, BATCH_ITEMS, NULL, true},
+	{"ctx", encodeCtx, 1, NULL, true},
+	{"rgba_stride", encodeRGBA, 1, NULL, false},
+};
+#define ENCODE_ENGINES (sizeof(encodeEngines) / sizeof(encodeEngines[0]))
+
+// decode engines
+
+static blurhash_error_t decodeMt(const char *hash, int width, int height, int punch, int nChannels, uint8_t *buffer) {
+	return blurhash_decode_mt(hash, width, height, punch, nChannels, buffer, 0);
+}
+
+static blurhash_error_t decodeCtx(const char *hash, int width, int height, int punch, int nChannels, uint8_t *buffer) {
+	if(!benchCtx && blurhash_ctx_create(&benchCtx)) return blurhash_error_malloc;
+	return blurhash_decode_ctx(benchCtx, hash, width, height, punch, nChannels, buffer);
+}
+
+struct decodeEngine {
+	const char *name;
+	blurhash_error_t (*decode)(const char *hash, int width, int height, int punch, int nChannels, uint8_t *buffer);
+	// reach: how far from a pixel, in pixels along x and y, the engine may take its basis, see decodeWithin; NULL is exact
+	void (*reach)(const char *hash, int width, int height, float reach[2]);
+};
+
+// fastDecodeSpacing: the distance of the grid points of blurhash_decode_fast along an axis of n pixels,
+// 0 where there is one point per pixel
+static float fastDecodeSpacing(int n, int components) {
+	int samples = BLURHASH_FAST_DECODE_SAMPLES * components;
+	if(samples < 2) samples = 2;
+	return samples < n ? (float)(n - 1) / (samples - 1) : 0;
+}
+
+// fastDecodeReach: a pixel of blurhash_decode_fast is interpolated from the grid points up to one spacing away
+static void fastDecodeReach(const char *hash, int width, int height, float reach[2]) {
+	int sizeFlag = blurhash_base83_decode_int(hash, 0, 1);
+	reach[0] = fastDecodeSpacing(width, sizeFlag % 9 + 1);
+	reach[1] = fastDecodeSpacing(height, sizeFlag / 9 + 1);
+}
+
+static const struct decodeEngine decodeEngines[] = {
+	{"exact", blurhash_decode, NULL},
+	{"mt", decodeMt, NULL},
+	{"fast", blurhash_decode_fast, fastDecodeReach},
+	{"fixed", blurhash_decode_fixed, NULL},
+	{"ctx", decodeCtx, NULL},
+};
+#define DECODE_ENGINES (sizeof(decodeEngines) / sizeof(decodeEngines[0]))
+
+// reference implementation: the original per-pixel, per-component algorithm with exact sRGB conversion
+
+static int quantiseMaximum(float actualMaximumValue) {
+	return fmaxf(0, fminf(82, floorf(actualMaximumValue * 166 - 0.5)));
+}
+
+static int quantiseAC(float value, float maximumValue) {
+	return fmaxf(0, fminf(18, floorf(blurhash_signPow(value / maximumValue, 0.5) * 9 + 9.5)));
+}
+
+// sRGBUnrounded: blurhash_linearTosRGB_exact before rounding
+static float sRGBUnrounded(float value) {
+	float v = fmaxf(0, fminf(1, value));
+	if(v <= 0.0031308) return v * 12.92 * 255;
+	else return (1.055 * powf(v, 1 / 2.4) - 0.055) * 255;
+}
+
+// referenceEncode: hash, and the linear factors it quantises as [yComponents * xComponents][3]
+static void referenceEncode(int xComponents, int yComponents, int width, int height, const uint8_t *rgb, float (*factors)[3], char *hash) {
+	for(int j = 0; j < yComponents; j++) {
+		for(int i = 0; i < xComponents; i++) {
+			float r = 0, g = 0, b = 0;
+			for(int y = 0; y < height; y++) {
+				for(int x = 0; x < width; x++) {
+					float basis = cosf(M_PI * i * x / width) * cosf(M_PI * j * y / height);
+					const uint8_t *px = rgb + ((size_t)y * width + x) * 3;
+					r += basis * blurhash_sRGBToLinear_exact(px[0]);
+					g += basis * blurhash_sRGBToLinear_exact(px[1]);
+					b += basis * blurhash_sRGBToLinear_exact(px[2]);
+				}
+			}
+			float scale = (i == 0 && j == 0 ? 1 : 2) / (float)(width * height);
+			factors[j * xComponents + i][0] = r * scale;
+			factors[j * xComponents + i][1] = g * scale;
+			factors[j * xComponents + i][2] = b * scale;
+		}
+	}
+
+	int acCount = xComponents * yComponents - 1;
+	char *ptr = blurhash_base83_encode_int((xComponents - 1) + (yComponents - 1) * 9, 1, hash);
+	float maximumValue = 1;
+	if(acCount > 0) {
+		float actualMaximumValue = 0;
+		for(int k = 1; k <= acCount; k++) {
+			for(int c = 0; c < 3; c++) actualMaximumValue = fmaxf(fabsf(factors[k][c]), actualMaximumValue);
+		}
+		int quantisedMaximumValue = quantiseMaximum(actualMaximumValue);
+		maximumValue = ((float)quantisedMaximumValue + 1) / 166;
+		ptr = blurhash_base83_encode_int(quantisedMaximumValue, 1, ptr);
+	} else {
+		ptr = blurhash_base83_encode_int(0, 1, ptr);
+	}
+	int dc = (blurhash_linearTosRGB_exact(factors[0][0]) << 16) + (blurhash_linearTosRGB_exact(factors[0][1]) << 8) + blurhash_linearTosRGB_exact(factors[0][2]);
+	ptr = blurhash_base83_encode_int(dc, 4, ptr);
+	for(int k = 1; k <= acCount; k++) {
+		int quant[3];
+		for(int c = 0; c < 3; c++) quant[c] = quantiseAC(factors[k][c], maximumValue);
+		ptr = blurhash_base83_encode_int(quant[0] * 19 * 19 + quant[1] * 19 + quant[2], 2, ptr);
+	}
+	*ptr = 0;
+}
+
+// referenceDecode: buffer, and the linear value of every channel before conversion as [height][width][3]
+static void referenceDecode(const char *hash, int width, int height, int punch, int nChannels, uint8_t *buffer, float *linear) {
+	int sizeFlag = blurhash_base83_decode_int(hash, 0, 1);
+	int numY = sizeFlag / 9 + 1, numX = sizeFlag % 9 + 1;
+	float maxValue = (blurhash_base83_decode_int(hash, 1, 2) + 1) / 166.0f * punch;
+	float colors[numX * numY][3];
+	int dc = blurhash_base83_decode_int(hash, 2, 6);
+	colors[0][0] = blurhash_sRGBToLinear_exact(dc >> 16);
+	colors[0][1] = blurhash_sRGBToLinear_exact((dc >> 8) & 255);
+	colors[0][2] = blurhash_sRGBToLinear_exact(dc & 255);
+	for(int k = 1; k < numX * numY; k++) {
+		int value = blurhash_base83_decode_int(hash, 4 + k * 2, 6 + k * 2);
+		int quant[3] = {value / (19 * 19), value / 19 % 19, value % 19};
+		for(int c = 0; c < 3; c++) colors[k][c] = blurhash_signPow((quant[c] - 9) / 9.0f, 2.0) * maxValue;
+	}
+	for(int y = 0; y < height; y++) {
+		for(int x = 0; x < width; x++) {
+			float *pixel = linear + ((size_t)y * width + x) * 3;
+			pixel[0] = pixel[1] = pixel[2] = 0;
+			for(int j = 0; j < numY; j++) {
+				for(int i = 0; i < numX; i++) {
+					float basis = cos((M_PI * x * i) / width) * cos((M_PI * y * j) / height);
+					for(int c = 0; c < 3; c++) pixel[c] += colors[i + j * numX][c] * basis;
+				}
+			}
+			uint8_t *px = buffer + ((size_t)y * width + x) * nChannels;
+			for(int c = 0; c < 3; c++) px[c] = blurhash_linearTosRGB_exact(pixel[c]);
+			if(nChannels == 4) px[3] = 255;
+		}
+	}
+}
+
+// error bounds of --check
+//
+// Every engine must stay within a bound that follows from how it computes, not from what it was last seen to do.
+// An engine computing the same sums as the reference only adds up floats in another order and reads other tables:
+// CHECK_EPSILON and CHECK_SRGB_SLACK below. Engines that approximate take the basis of a pixel up to reach[0]
+// pixels away along x and reach[1] along y, and since |cos a - cos b| <= |a - b|, component (i, j) then moves by
+// at most pi * (i * reach[0] / width + j * reach[1] / height) times its weight. The bounds follow that through
+// the quantisation of the hash or the conversion to sRGB, so only a broken engine can exceed them.
+
+// CHECK_EPSILON bounds the error of a linear factor from float sums in another order and from the 16-bit linear table
+#define CHECK_EPSILON 1e-4f
+// CHECK_SRGB_SLACK bounds the error of blurhash_linearTosRGB_table in 8-bit steps, see blurhash_linearTosRGB in common.h
+#define CHECK_SRGB_SLACK 0.005f
+
+// encodeWithin: whether hash quantises the reference factors, each moved by at most its bound. The linear values of
+// the image sum to width * height * dc and an AC factor scales the sum by 2 / (width * height), so (i, j) moves by
+// at most 2 * dc * pi * (i * reach[0] / width + j * reach[1] / height); the quantisation is monotonic, so the hash
+// must lie between the quantisations of the lowest and the highest factors
+static bool encodeWithin(int xComponents, int yComponents, int width, int height, const float (*factors)[3], const float reach[2], const char *hash) {
+	int acCount = xComponents * yComponents - 1;
+	if(strlen(hash) != (size_t)6 + 2 * acCount || blurhash_base83_decode_int(hash, 0, 1) != (xComponents - 1) + (yComponents - 1) * 9) return false;
+
+	float error[acCount + 1][3];
+	for(int j = 0; j < yComponents; j++) {
+		for(int i = 0; i < xComponents; i++) {
+			float spread = 2 * M_PI * (i * reach[0] / width + j * reach[1] / height);
+			for(int c = 0; c < 3; c++) error[j * xComponents + i][c] = spread * factors[0][c] + CHECK_EPSILON;
+		}
+	}
+
+	int dc = blurhash_base83_decode_int(hash, 2, 6);
+	for(int c = 0; c < 3; c++) {
+		int value = dc >> (16 - 8 * c) & 255;
+		if(dc < 0 || value < floorf(sRGBUnrounded(factors[0][c] - error[0][c]) - CHECK_SRGB_SLACK + 0.5f)
+			|| value > floorf(sRGBUnrounded(factors[0][c] + error[0][c]) + CHECK_SRGB_SLACK + 0.5f)) return false;
+	}
+
+	int quantisedMaximumValue = blurhash_base83_decode_int(hash, 1, 2);
+	if(!acCount) return quantisedMaximumValue == 0;
+	float lowest = 0, highest = 0;
+	for(int k = 1; k <= acCount; k++) {
+		for(int c = 0; c < 3; c++) {
+			lowest = fmaxf(lowest, fabsf(factors[k][c]) - error[k][c]);
+			highest = fmaxf(highest, fabsf(factors[k][c]) + error[k][c]);
+		}
+	}
+	if(quantisedMaximumValue < quantiseMaximum(lowest) || quantisedMaximumValue > quantiseMaximum(highest)) return false;
+
+	float maximumValue = ((float)quantisedMaximumValue + 1) / 166;
+	for(int k = 1; k <= acCount; k++) {
+		int value = blurhash_base83_decode_int(hash, 4 + k * 2, 6 + k * 2);
+		if(value < 0) return false;
+		int quant[3] = {value / (19 * 19), value / 19 % 19, value % 19};
+		for(int c = 0; c < 3; c++) {
+			if(quant[c] < quantiseAC(factors[k][c] - error[k][c], maximumValue) || quant[c] > quantiseAC(factors[k][c] + error[k][c], maximumValue)) return false;
+		}
+	}
+	return true;
+}
+
+// decodeWithin: whether every rgba pixel of actual is within its bound of the reference decode expected. A basis
+// taken up to reach pixels away moves the linear value v of a channel by at most L = sum(|color| * pi * (i * reach[0]
+// / width + j * reach[1] / height)); interpolating in sRGB between such points stays between sRGB(v - L) and
+// sRGB(v + L), and the rounding of both decodes adds 1
+static bool decodeWithin(const char *hash, int width, int height, int punch, const float reach[2], const float *linear, const uint8_t *expected, const uint8_t *actual) {
+	float spread[3] = {0, 0, 0};
+	if(reach[0] || reach[1]) {
+		int sizeFlag = blurhash_base83_decode_int(hash, 0, 1);
+		int numY = sizeFlag / 9 + 1, numX = sizeFlag % 9 + 1;
+		float maxValue = (blurhash_base83_decode_int(hash, 1, 2) + 1) / 166.0f * punch;
+		for(int k = 1; k < numX * numY; k++) {
+			int value = blurhash_base83_decode_int(hash, 4 + k * 2, 6 + k * 2);
+			int quant[3] = {value / (19 * 19), value / 19 % 19, value % 19};
+			float distance = M_PI * (k % numX * reach[0] / width + k / numX * reach[1] / height);
+			for(int c = 0; c < 3; c++) spread[c] += fabsf(blurhash_signPow((quant[c] - 9) / 9.0f, 2.0) * maxValue) * distance;
+		}
+	}
+	for(size_t p = 0; p < (size_t)width * height; p++) {
+		for(int c = 0; c < 3; c++) {
+			float v = linear[p * 3 + c], exact = sRGBUnrounded(v);
+			float bound = fmaxf(sRGBUnrounded(v + spread[c]) - exact, exact - sRGBUnrounded(v - spread[c])) + 1 + CHECK_SRGB_SLACK;
+			if(abs(actual[p * 4 + c] - expected[p * 4 + c]) > bound) return false;
+		}
+		if(actual[p * 4 + 3] != 255) return false;
+	}
+	return true;
+}
+
+// hashDelta: the largest difference of a quantised value between two hashes of the same size, INT_MAX otherwise
+static int hashDelta(const char *a, const char *b) {
+	size_t length = strlen(a);
+	if(length != strlen(b) || a[0] != b[0]) return INT_MAX;
+	int delta = abs(blurhash_base83_decode_int(a, 1, 2) - blurhash_base83_decode_int(b, 1, 2));
+	int dcA = blurhash_base83_decode_int(a, 2, 6), dcB = blurhash_base83_decode_int(b, 2, 6);
+	for(int shift = 0; shift <= 16; shift += 8) {
+		int d = abs((dcA >> shift & 255) - (dcB >> shift & 255));
+		if(d > delta) delta = d;
+	}
+	for(size_t k = 6; k + 2 <= length; k += 2) {
+		int valueA = blurhash_base83_decode_int(a, k, k + 2), valueB = blurhash_base83_decode_int(b, k, k + 2);
+		int steps[3] = {valueA / 361 - valueB / 361, valueA / 19 % 19 - valueB / 19 % 19, valueA % 19 - valueB % 19};
+		for(int c = 0; c < 3; c++) {
+			if(abs(steps[c]) > delta) delta = abs(steps[c]);
+		}
+	}
+	return delta;
+}
+
+struct checkResult {
+	const char *op, *engine;
+	long cases, differing, violations; // violations: cases outside the error bound of the engine
+	int maxDelta;
+};
+
+static void checkCase(struct checkResult *result, int delta, bool within) {
+	result->cases++;
+	if(delta) result->differing++;
+	if(!within) result->violations++;
+	if(delta > result->maxDelta) result->maxDelta = delta;
+}
+
+static void printCheck(const struct checkResult *result, bool last) {
+	printf("    {\"op\": \"%s\", \"engine\": \"%s\", \"cases\": %ld, \"differing\": %ld, \"max_delta\": %d, \"violations\": %ld, \"pass\": %s}%s\n",
+		result->op, result->engine, result->cases, result->differing, result->maxDelta, result->violations,
+		result->violations ? "false" : "true", last ? "" : ",");
+}
+
+// runCheck: every engine against the reference algorithm on small images of every pattern and component count
+static int runCheck(void) {
+	static const int sizes[][2] = {{1, 1}, {7, 5}, {64, 48}, {200, 133}};
+	static const int decodeSizes[][2] = {{1, 1}, {7, 5}, {64, 48}, {160, 120}};
+	struct checkResult encodeResults[ENCODE_ENGINES], decodeResults[DECODE_ENGINES];
+	for(size_t e = 0; e < ENCODE_ENGINES; e++) encodeResults[e] = (struct checkResult){"encode", encodeEngines[e].name, 0, 0, 0, 0};
+	for(size_t e = 0; e < DECODE_ENGINES; e++) decodeResults[e] = (struct checkResult){"decode", decodeEngines[e].name, 0, 0, 0, 0};
+
+	uint8_t *rgb = malloc(200 * 133 * 3);
+	uint8_t *expected = malloc(160 * 120 * 4), *actual = malloc(160 * 120 * 4);
+	float *linear = malloc(sizeof(float) * 160 * 120 * 3);
+	if(!rgb || !expected || !actual || !linear) return blurhash_perror(blurhash_error_malloc);
+
+	for(int pattern = 0; pattern < PATTERN_COUNT; pattern++) {
+		for(size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+			int width = sizes[s][0], height = sizes[s][1];
+			fillPattern(pattern, width, height, rgb);
+			for(int yComponents = 1; yComponents <= 9; yComponents++) {
+				for(int xComponents = 1; xComponents <= 9; xComponents++) {
+					char reference[BLURHASH_ENCODE_BUFSZ], hash[BLURHASH_ENCODE_BUFSZ];
+					float factors[xComponents * yComponents][3];
+					referenceEncode(xComponents, yComponents, width, height, rgb, factors, reference);
+					for(size_t e = 0; e < ENCODE_ENGINES; e++) {
+						float reach[2] = {0, 0};
+						if(encodeEngines[e].reach) encodeEngines[e].reach(width, height, reach);
+						if(encodeEngines[e].encode(xComponents, yComponents, width, height, rgb, hash)) checkCase(&encodeResults[e], INT_MAX, false);
+						else checkCase(&encodeResults[e], hashDelta(reference, hash), encodeWithin(xComponents, yComponents, width, height, factors, reach, hash));
+					}
+
+					// decode the reference hash of the largest image at a few sizes
+					if(s != sizeof(sizes) / sizeof(sizes[0]) - 1) continue;
+					for(size_t d = 0; d < sizeof(decodeSizes) / sizeof(decodeSizes[0]); d++) {
+						int outWidth = decodeSizes[d][0], outHeight = decodeSizes[d][1];
+						for(int punch = 1; punch <= 2; punch++) {
+							referenceDecode(reference, outWidth, outHeight, punch, 4, expected, linear);
+							for(size_t e = 0; e < DECODE_ENGINES; e++) {
+								float reach[2] = {0, 0};
+								if(decodeEngines[e].reach) decodeEngines[e].reach(reference, outWidth, outHeight, reach);
+								if(decodeEngines[e].decode(reference, outWidth, outHeight, punch, 4, actual)) {
+									checkCase(&decodeResults[e], INT_MAX, false);
+									continue;
+								}
+								int delta = 0;
+								for(size_t k = 0; k < (size_t)outWidth * outHeight * 4; k++) {
+									int channelDelta = abs(expected[k] - actual[k]);
+									if(channelDelta > delta) delta = channelDelta;
+								}
+								checkCase(&decodeResults[e], delta, decodeWithin(reference, outWidth, outHeight, punch, reach, linear, expected, actual));
+							}
+						}
+					}
+				}
+			}
+		}
+	}
+	free(rgb); free(expected); free(actual); free(linear);
+
+	bool pass = true;
+	puts("{\n  \"check\": [");
+	for(size_t e = 0; e < ENCODE_ENGINES; e++) {
+		printCheck(&encodeResults[e], false);
+		pass &= !encodeResults[e].violations;
+	}
+	for(size_t e = 0; e < DECODE_ENGINES; e++) {
+		printCheck(&decodeResults[e], e == DECODE_ENGINES - 1);
+		pass &= !decodeResults[e].violations;
+	}
+	printf("  ],\n  \"pass\": %s\n}\n", pass ? "true" : "false");
+	return pass ? 0 : 1;
+}
+
+struct benchOptions {
+	int sizes[16][2], sizeCount;
+	int components[81][2], componentCount;
+	int pattern;
+	const char *engines; // comma separated names, NULL = all
+	uint64_t minNs;
+};
+
+static bool engineSelected(const struct benchOptions *options, const char *op, const char *name) {
+	if(!options->engines) return true;
+	char qualified[64];
+	snprintf(qualified, sizeof(qualified), "%s:%s", op, name);
+	size_t length = strlen(name), qualifiedLength = strlen(qualified);
+	for(const char *p = options->engines; *p; ) {
+		size_t token = strcspn(p, ",");
+		if((token == length && !strncmp(p, name, length)) || (token == qualifiedLength && !strncmp(p, qualified, qualifiedLength))) return true;
+		p += token + (p[token] == ',');
+	}
+	return false;
+}
+
+// printResult: one JSON object of timing results
+static void printResult(bool *first, const char *op, const char *engine, int pattern, int width, int height, int xComponents, int yComponents,
+	long calls, int hashesPerCall, uint64_t ns, long allocs) {
+	double nsPerHash = (double)ns / calls / hashesPerCall;
+	printf("%s    {\"op\": \"%s\", \"engine\": \"%s\", \"pattern\": \"%s\", \"width\": %d, \"height\": %d, \"x_components\": %d, \"y_components\": %d, "
+		"\"hashes\": %ld, \"ns_per_hash\": %.0f, \"mp_per_s\": %.3f, \"allocs_per_hash\": ",
+		*first ? "" : ",\n", op, engine, patterns[pattern], width, height, xComponents, yComponents, calls * hashesPerCall, nsPerHash,
+		(double)width * height / nsPerHash * 1e3);
+	if(allocs < 0) fputs("null}", stdout);
+	else printf("%.2f}", (double)allocs / calls / hashesPerCall);
+	*first = false;
+}
+
+static int runBench(const struct benchOptions *options) {
+	bool first = true;
+	#ifdef BLURHASH_NO_DISPATCH
+		const char *dispatch = "false";
+	#else
+		const char *dispatch = "true";
+	#endif
+	printf("{\n  \"dispatch\": %s,\n  \"results\": [\n", dispatch);
+
+	for(int s = 0; s < options->sizeCount; s++) {
+		int width = options->sizes[s][0], height = options->sizes[s][1];
+		size_t pixels = (size_t)width * height;
+		uint8_t *rgb = malloc(pixels * 3), *decoded = malloc(pixels * 4);
+		if(!rgb || !decoded) {
+			free(rgb); free(decoded);
+			fputs("\n  ]\n}\n", stdout);
+			return blurhash_perror(blurhash_error_malloc);
+		}
+		fillPattern(options->pattern, width, height, rgb);
+
+		for(int c = 0; c < options->componentCount; c++) {
+			int xComponents = options->components[c][0], yComponents = options->components[c][1];
+			char hash[BLURHASH_ENCODE_BUFSZ];
+			blurhash_encode(xComponents, yComponents, width, height, rgb, hash);
+			fprintf(stderr, "%dx%d %dx%d %s\n", width, height, xComponents, yComponents, hash);
+
+			for(size_t e = 0; e < ENCODE_ENGINES; e++) {
+				const struct encodeEngine *engine = &encodeEngines[e];
+				if(!engine->timed || !engineSelected(options, "encode", engine->name)) continue;
+				char result[BLURHASH_ENCODE_BUFSZ];
+				long calls = 0, allocs = allocations();
+				uint64_t start = nowNs(), elapsed;
+				do {
+					blurhash_error_t err = engine->encode(xComponents, yComponents, width, height, rgb, result);
+					if(err) return blurhash_perror(err);
+					calls++;
+				} while((elapsed = nowNs() - start) < options->minNs);
+				if(allocs >= 0) allocs = allocations() - allocs;
+				printResult(&first, "encode", engine->name, options->pattern, width, height, xComponents, yComponents, calls, engine->hashesPerCall, elapsed, allocs);
+			}
+
+			for(size_t e = 0; e < DECODE_ENGINES; e++) {
+				const struct decodeEngine *engine = &decodeEngines[e];
+				if(!engineSelected(options, "decode", engine->name)) continue;
+				long calls = 0, allocs = allocations();
+				uint64_t start = nowNs(), elapsed;
+				do {
+					blurhash_error_t err = engine->decode(hash, width, height, 1, 4, decoded);
+					if(err) return blurhash_perror(err);
+					calls++;
+				} while((elapsed = nowNs() - start) < options->minNs);
+				if(allocs >= 0) allocs = allocations() - allocs;
+				printResult(&first, "decode", engine->name, options->pattern, width, height, xComponents, yComponents, calls, 1, elapsed, allocs);
+			}
+		}
+		free(rgb); free(decoded);
+	}
+	fputs("\n  ]\n}\n", stdout);
+	return 0;
+}
+
+static void printBenchUsage(void) {
+	fputs("blurhash_bench [options]\n", stderr);
+	fputs("  -s WxH      image size, repeatable (default 32x32 320x240 1920x1080 4000x3000 8660x5773)\n", stderr);
+	fputs("  -c XxY      component counts, repeatable (default 1x1 ~ 9x9)\n", stderr);
+	fputs("  -p pattern  gradient, noise or photo (default photo)\n", stderr);
+	fputs("  -e engines  comma separated engine names, optionally as encode:name or decode:name (default all)\n", stderr);
+	fputs("  -t ms       minimum time per measurement (default 200)\n", stderr);
+	fputs("  --quick     sizes up to 1920x1080 and 20 ms per measurement\n", stderr);
+	fputs("  --check     compare every engine against the reference algorithm instead, exit 1 on failure\n", stderr);
+	fputs("encode engines: exact mt fast incremental batch ctx; decode engines: exact mt fast fixed ctx\n", stderr);
+}
+
+int main(int argc, const char **argv) {
+	static const int defaultSizes[][2] = {{32, 32}, {320, 240}, {1920, 1080}, {4000, 3000}, {8660, 5773}};
+	struct benchOptions options = {.sizeCount = 0, .componentCount = 0, .pattern = 2, .engines = NULL, .minNs = 200000000};
+	bool quick = false;
+
+	for(int i = 1; i < argc; i++) {
+		const char *arg = argv[i], *value = i + 1 < argc ? argv[i + 1] : NULL;
+		if(!strcmp(arg, "--check")) return runCheck();
+		if(!strcmp(arg, "--quick")) {
+			quick = true;
+			continue;
+		}
+		if(!value || arg[0] != '-' || !arg[1] || arg[2]) {
+			printBenchUsage();
+			return -1;
+		}
+		i++;
+		switch(arg[1]) {
+			case 's':
+				if(options.sizeCount == 16 || sscanf(value, "%dx%d", &options.sizes[options.sizeCount][0], &options.sizes[options.sizeCount][1]) != 2
+					|| options.sizes[options.sizeCount][0] < 1 || options.sizes[options.sizeCount][1] < 1) {
+					printBenchUsage();
+					return -1;
+				}
+				options.sizeCount++;
+				break;
+			case 'c': {
+				int *components = options.components[options.componentCount];
+				if(options.componentCount == 81 || sscanf(value, "%dx%d", &components[0], &components[1]) != 2) {
+					printBenchUsage();
+					return -1;
+				}
+				blurhash_error_t err = blurhash_checkComponents(components[0], components[1]);
+				if(err) return blurhash_perror(err);
+				options.componentCount++;
+				break;
+			}
+			case 'p':
+				for(options.pattern = 0; options.pattern < PATTERN_COUNT && strcmp(value, patterns[options.pattern]); options.pattern++);
+				if(options.pattern == PATTERN_COUNT) {
+					printBenchUsage();
+					return -1;
+				}
+				break;
+			case 'e':
+				options.engines = value;
+				break;
+			case 't':
+				options.minNs = (uint64_t)atoi(value) * 1000000;
+				break;
+			default:
+				printBenchUsage();
+				return -1;
+		}
+	}
+
+	if(quick) options.minNs = 20000000;
+	if(!options.sizeCount) {
+		for(size_t s = 0; s < sizeof(defaultSizes) / sizeof(defaultSizes[0]); s++) {
+			if(quick && (int64_t)defaultSizes[s][0] * defaultSizes[s][1] > 1920 * 1080) break;
+			memcpy(options.sizes[options.sizeCount++], defaultSizes[s], sizeof(defaultSizes[s]));
+		}
+	}
+	if(!options.componentCount) {
+		for(int k = 1; k <= 9; k++) {
+			options.components[options.componentCount][0] = k;
+			options.components[options.componentCount++][1] = k;
+		}
+	}
+
+	return runBench(&options);
+}
@@ -21,9 +21,14 @@
  * SOFTWARE.
  */
 
+#include <errno.h>
+#include <pthread.h>
 #include <stdio.h>
+#include <strings.h>
+#include <unistd.h>
 
 #include "blurhash.h"
+#include "serve.h"
 
 static void print_usage() {
 	#ifndef BLURHASH_VERSION
@@ -39,12 +44,356 @@ static void print_usage() {
 			BLURHASH_VERSION_DATE
 		"). Usage:\n", stderr
 	);
-	fputs("blurhash [e|d]\n", stderr);
+	fputs("blurhash [--stats] [--png-level=N] [e|d|eb|db|serve|client|index]\n", stderr);
 	fputs("  e(encode): x_components y_components imagefile\n", stderr);
 	fputs("  d(decode): hash width height output_file [punch]\n", stderr);
+	fputs("  eb(encode batch): x_components y_components [-j threads] [-0] [-k]\n", stderr);
+	fputs("    reads image paths from stdin, writes `path\\thash` or `path\\terror` lines\n", stderr);
+	fputs("  db(decode batch): [-j threads] [-0] [-k]\n", stderr);
+	fputs("    reads `hash\\twidth\\theight\\toutput_file[\\tpunch]` lines from stdin,\n", stderr);
+	fputs("    writes `output_file\\tok` or `output_file\\terror` lines\n", stderr);
+	fputs("  serve: --socket PATH [-j threads]\n", stderr);
+	fputs("    answers length-prefixed encode and decode requests on a Unix socket until SIGINT or SIGTERM\n", stderr);
+	fputs("  client: --socket PATH\n", stderr);
+	fputs("    reads `e|f\\tx\\ty\\timagefile` (e sends the bytes, f the path) and `d\\thash\\twidth\\theight\\toutput_file[\\tpunch]`\n", stderr);
+	fputs("    lines from stdin, pipelines them to a server and writes `imagefile\\thash` or `output_file\\tok` lines\n", stderr);
+	fputs("  index build: index_file [-j threads]\n", stderr);
+	fputs("    reads `hash[\\tid]` lines from stdin (id defaults to the line number) into a similarity index\n", stderr);
+	fputs("  index knn: index_file k [hash...], index radius: index_file r [hash...]\n", stderr);
+	fputs("    finds the k nearest or all within r of each hash, or of the hashes on stdin, writes `hash\\tid\\tdistance` lines\n", stderr);
+	fputs("  batch options: -j worker threads (default all CPUs), -0 NUL-separated records, -k keep input order\n", stderr);
+	fputs("  output files are PNG unless named *.ppm, *.pam, *.qoi or *.raw (RGBA), `-` is PNG to stdout\n", stderr);
+	fputs("  --png-level: zlib level of PNG output, 0 (stored, streamed) to 9, default 8\n", stderr);
+	fputs("  --stats: print call counts, timings and latency histograms to stderr on exit\n", stderr);
+}
+
+// print_stats: atexit handler of --stats
+static void print_stats(void) {
+	static const char *ops[blurhash_stats_op_count] = {"encode", "decode"};
+	static const char *stages[blurhash_stats_stage_count] = {"load", "accumulate", "quantise", "parse", "render", "write"};
+	blurhash_stats_t stats;
+	blurhash_stats_get(&stats);
+	for(int op = 0; op < blurhash_stats_op_count; op++) {
+		if(!stats.calls[op]) continue;
+		fprintf(stderr, "%s: calls %llu errors %llu pixels %llu bytes %llu ns %llu\n", ops[op],
+			(unsigned long long)stats.calls[op], (unsigned long long)stats.errors[op], (unsigned long long)stats.pixels[op],
+			(unsigned long long)stats.bytes[op], (unsigned long long)stats.ns[op]);
+		for(int k = 0; k < BLURHASH_STATS_BUCKETS; k++) {
+			if(stats.histogram[op][k]) fprintf(stderr, "  %s latency >= %llu ns: %llu\n", ops[op], 1ULL << k, (unsigned long long)stats.histogram[op][k]);
+		}
+	}
+	for(int stage = 0; stage < blurhash_stats_stage_count; stage++) {
+		if(stats.stageNs[stage]) fprintf(stderr, "stage %s: ns %llu\n", stages[stage], (unsigned long long)stats.stageNs[stage]);
+	}
+}
+
+// png_level: zlib level of PNG output, set by --png-level
+static int png_level = BLURHASH_PNG_LEVEL_DEFAULT;
+
+blurhash_file_format_t blurhash_output_format(const char *filename) {
+	const char *dot = strrchr(filename, '.');
+	if(dot) {
+		if(!strcasecmp(dot, ".ppm")) return blurhash_file_format_ppm;
+		if(!strcasecmp(dot, ".pam")) return blurhash_file_format_pam;
+		if(!strcasecmp(dot, ".qoi")) return blurhash_file_format_qoi;
+		if(!strcasecmp(dot, ".raw")) return blurhash_file_format_raw;
+	}
+	return blurhash_file_format_png;
+}
+
+// decode_output: decodes hash into RGBA output_file in the format of its name, `-` being PNG to stdout
+static blurhash_error_t decode_output(const char *hash, int width, int height, int punch, const char *output_file) {
+	const int nChannels = 4;
+	if(!strcmp(output_file, "-"))
+		return blurhash_decode_fd(hash, width, height, punch, nChannels, blurhash_file_format_png, png_level, STDOUT_FILENO);
+	return blurhash_decode_file_ex(hash, width, height, punch, nChannels, blurhash_output_format(output_file), png_level, output_file);
+}
+
+// batch_state: shared by the workers of the eb/db batch modes
+struct batch_state {
+	pthread_mutex_t in, out;
+	pthread_cond_t turn;
+	size_t next_in, next_out;
+	char delim;
+	bool ordered, decode;
+	int x_components, y_components;
+	int failed;
+};
+
+// batch_decode_line: decodes one `hash\twidth\theight\toutput[\tpunch]` record, line is modified
+static blurhash_error_t batch_decode_line(char *line, const char **output_file) {
+	char *fields[5] = {line, NULL, NULL, NULL, NULL};
+	int n = 1;
+	for(char *p = line; *p && n < 5; p++) {
+		if(*p == '\t') {
+			*p = 0;
+			fields[n++] = p + 1;
+		}
+	}
+	*output_file = n >= 4 ? fields[3] : line;
+	if(n < 4) {
+		errno = EINVAL;
+		return blurhash_error_invalid_hash;
+	}
+
+	int width = atoi(fields[1]), height = atoi(fields[2]);
+	int punch = n == 5 ? atoi(fields[4]) : 1;
+	if(width <= 0 || height <= 0) {
+		errno = EINVAL;
+		return blurhash_error_invalid_hash;
+	}
+
+	return decode_output(fields[0], width, height, punch, *output_file);
+}
+
+static void *batch_worker(void *arg) {
+	struct batch_state *state = (struct batch_state *)arg;
+	char *line = NULL;
+	size_t line_cap = 0;
+
+	for(;;) {
+		pthread_mutex_lock(&state->in);
+		ssize_t len = getdelim(&line, &line_cap, state->delim, stdin);
+		size_t seq = state->next_in;
+		if(len >= 0) state->next_in++;
+		pthread_mutex_unlock(&state->in);
+		if(len < 0) break;
+
+		if(len > 0 && line[len - 1] == state->delim) line[--len] = 0;
+		if(state->delim == '\n' && len > 0 && line[len - 1] == '\r') line[--len] = 0;
+
+		const char *key = line, *result;
+		char hash[BLURHASH_ENCODE_BUFSZ];
+		blurhash_error_t err;
+		if(state->decode) {
+			err = batch_decode_line(line, &key);
+			result = err ? blurhash_strerror(err) : "ok";
+		} else {
+			err = blurhash_encode_file(state->x_components, state->y_components, line, hash);
+			result = err ? blurhash_strerror(err) : hash;
+		}
+
+		pthread_mutex_lock(&state->out);
+		if(state->ordered) {
+			while(seq != state->next_out) pthread_cond_wait(&state->turn, &state->out);
+		}
+		fprintf(stdout, "%s\t%s%c", key, result, state->delim);
+		fflush(stdout);
+		if(err) state->failed++;
+		if(state->ordered) {
+			state->next_out++;
+			pthread_cond_broadcast(&state->turn);
+		}
+		pthread_mutex_unlock(&state->out);
+	}
+
+	free(line);
+	return NULL;
+}
+
+// run_batch: parses the batch options in argv and runs the workers until stdin is drained
+static int run_batch(int argc, const char **argv, struct batch_state *state) {
+	int nthreads = 0;
+	state->delim = '\n';
+	state->ordered = false;
+	for(int i = 0; i < argc; i++) {
+		if(!strcmp(argv[i], "-j") && i + 1 < argc) nthreads = atoi(argv[++i]);
+		else if(!strcmp(argv[i], "-0")) state->delim = 0;
+		else if(!strcmp(argv[i], "-k")) state->ordered = true;
+		else {
+			print_usage();
+			return -1;
+		}
+	}
+	if(nthreads <= 0) nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+	if(nthreads < 1) nthreads = 1;
+
+	pthread_mutex_init(&state->in, NULL);
+	pthread_mutex_init(&state->out, NULL);
+	pthread_cond_init(&state->turn, NULL);
+	state->next_in = state->next_out = 0;
+	state->failed = 0;
+
+	pthread_t *threads = (pthread_t *)malloc(sizeof(pthread_t) * nthreads);
+	int started = 0;
+	while(threads && started < nthreads - 1 && pthread_create(&threads[started], NULL, batch_worker, state) == 0) started++;
+	batch_worker(state);
+	for(int i = 0; i < started; i++) pthread_join(threads[i], NULL);
+	free(threads);
+
+	pthread_cond_destroy(&state->turn);
+	pthread_mutex_destroy(&state->out);
+	pthread_mutex_destroy(&state->in);
+
+	return state->failed ? 1 : 0;
+}
+
+// index_build: `blurhash index build INDEX [-j threads]`, reading `hash[\tid]` lines from stdin
+static int index_build(int argc, const char **argv) {
+	int nthreads = 0;
+	if(argc == 3 && !strcmp(argv[1], "-j")) nthreads = atoi(argv[2]);
+	else if(argc != 1) {
+		print_usage();
+		return -1;
+	}
+
+	blurhash_index_writer_t *writer;
+	blurhash_error_t err = blurhash_index_writer_begin(&writer, argv[0]);
+	if(err) return blurhash_perror(err);
+
+	char *line = NULL;
+	size_t line_cap = 0;
+	uint64_t line_no = 0;
+	int failed = 0;
+	ssize_t len;
+	for(; (len = getline(&line, &line_cap, stdin)) >= 0; line_no++) {
+		while(len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r')) line[--len] = 0;
+		char *tab = strchr(line, '\t');
+		uint64_t id = line_no;
+		if(tab) {
+			*tab = 0;
+			id = strtoull(tab + 1, NULL, 10);
+		}
+		err = blurhash_index_writer_add(writer, line, id);
+		if(err == blurhash_error_write) break;
+		if(err) {
+			fprintf(stderr, "%s\t%s\n", line, blurhash_strerror(err));
+			failed++;
+		}
+	}
+	free(line);
+
+	if(err == blurhash_error_write) {
+		blurhash_index_writer_free(writer);
+		return blurhash_perror(err);
+	}
+	err = blurhash_index_writer_finish(writer, nthreads);
+	if(err) return blurhash_perror(err);
+	return failed ? 1 : 0;
+}
+
+// index_query: writes the `query\tid\tdistance` lines of the k-NN (radius < 0) or radius query of hash
+static blurhash_error_t index_query(const blurhash_index_t *index, const char *hash, size_t k, float radius, blurhash_match_t **matches, size_t *capacity) {
+	int8_t feature[BLURHASH_FEATURE_DIMS];
+	blurhash_error_t err = blurhash_feature(hash, feature);
+	if(err) return err;
+
+	size_t count;
+	if(radius < 0) {
+		err = blurhash_index_knn(index, feature, k, *matches, &count);
+	} else {
+		err = blurhash_index_radius(index, feature, radius, *matches, *capacity, &count);
+		if(!err && count > *capacity) {
+			// the first call counted the matches, the second one stores them all
+			blurhash_match_t *grown = (blurhash_match_t *)realloc(*matches, sizeof(blurhash_match_t) * count);
+			if(!grown) return blurhash_error_malloc;
+			*matches = grown;
+			*capacity = count;
+			err = blurhash_index_radius(index, feature, radius, *matches, *capacity, &count);
+		}
+	}
+	if(err) return err;
+	for(size_t i = 0; i < count; i++) {
+		printf("%s\t%llu\t%.2f\n", hash, (unsigned long long)(*matches)[i].id, (*matches)[i].distance);
+	}
+	return blurhash_error_ok;
+}
+
+// index_main: `blurhash index build|knn|radius ...`, argv after `index`
+static int index_main(int argc, const char **argv) {
+	if(argc >= 2 && !strcmp(argv[0], "build")) return index_build(argc - 1, argv + 1);
+	if(argc < 3 || (strcmp(argv[0], "knn") && strcmp(argv[0], "radius"))) {
+		print_usage();
+		return -1;
+	}
+
+	bool knn = !strcmp(argv[0], "knn");
+	size_t k = knn ? strtoull(argv[2], NULL, 10) : 0;
+	float radius = knn ? -1 : strtof(argv[2], NULL);
+	if((knn && k == 0) || (!knn && !(radius >= 0))) {
+		print_usage();
+		return -1;
+	}
+
+	blurhash_index_t *index;
+	blurhash_error_t err = blurhash_index_open(&index, argv[1]);
+	if(err) return blurhash_perror(err);
+
+	size_t capacity = knn ? k : 1024;
+	blurhash_match_t *matches = (blurhash_match_t *)malloc(sizeof(blurhash_match_t) * capacity);
+	if(!matches) {
+		blurhash_index_close(index);
+		return blurhash_perror(blurhash_error_malloc);
+	}
+
+	int failed = 0;
+	char *line = NULL;
+	size_t line_cap = 0;
+	ssize_t len;
+	for(int i = 3; argc == 3 || i < argc; i++) {
+		const char *hash;
+		if(argc > 3) hash = argv[i];
+		else if((len = getline(&line, &line_cap, stdin)) >= 0) {
+			while(len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r')) line[--len] = 0;
+			hash = line;
+		} else break;
+
+		err = index_query(index, hash, k, radius, &matches, &capacity);
+		if(err) {
+			printf("%s\t%s\n", hash, blurhash_strerror(err));
+			failed++;
+		}
+	}
+	free(line);
+	free(matches);
+	blurhash_index_close(index);
+	return failed ? 1 : 0;
 }
 
 int main(int argc, const char **argv) {
+	// --stats and --png-level may be given anywhere, they are taken out before the mode is parsed
+	int kept = 1;
+	bool stats = false;
+	for(int i = 1; i < argc; i++) {
+		if(!strcmp(argv[i], "--stats")) stats = true;
+		else if(!strncmp(argv[i], "--png-level=", 12)) png_level = atoi(argv[i] + 12);
+		else argv[kept++] = argv[i];
+	}
+	argc = kept;
+	if(stats) {
+		blurhash_stats_enable(true);
+		atexit(print_stats);
+	}
+
+	if(argc >= 2 && !strcmp(argv[1], "serve")) return serve_main(argc - 2, argv + 2);
+	if(argc >= 2 && !strcmp(argv[1], "client")) return client_main(argc - 2, argv + 2);
+	if(argc >= 2 && !strcmp(argv[1], "index")) return index_main(argc - 2, argv + 2);
+
+	if(argc >= 2 && argv[1][0] && argv[1][1] == 'b') {
+		struct batch_state state;
+		switch (argv[1][0]) {
+			case 'e':
+				if(argc < 4) break;
+				state.decode = false;
+				state.x_components = atoi(argv[2]);
+				state.y_components = atoi(argv[3]);
+				if(state.x_components < 1 || state.x_components > 9) {
+					errno = EINVAL;
+					return blurhash_perror(blurhash_error_invalid_x_components);
+				}
+				if(state.y_components < 1 || state.y_components > 9) {
+					errno = EINVAL;
+					return blurhash_perror(blurhash_error_invalid_y_components);
+				}
+				return run_batch(argc - 4, argv + 4, &state);
+			case 'd':
+				state.decode = true;
+				return run_batch(argc - 2, argv + 2, &state);
+		}
+		print_usage();
+		return -1;
+	}
+
 	if(argc < 5) {
 		print_usage();
 		return -1;
@@ -77,16 +426,10 @@ int main(int argc, const char **argv) {
             height = atoi(argv[4]);
             const char * output_file = argv[5];
 
-            const int nChannels = 4;
-        
             if(argc == 7)
                 punch = atoi(argv[6]);
-            
-            uint8_t* buffer = (uint8_t *)malloc(BLURHASH_DECODE_BUFSZ(width, height, nChannels));
-
-            blurhash_error_t err = blurhash_decode_file(hash, width, height, punch, nChannels, output_file, buffer);
 
-            free(buffer);
+            blurhash_error_t err = decode_output(hash, width, height, punch, output_file);
 
             if (err) {
                 blurhash_perror(err);
@@ -41,10 +41,30 @@ enum blurhash_error_t {
 	blurhash_error_invalid_decode_quantized_max_value,
 	blurhash_error_invalid_decode_dc,
 	blurhash_error_invalid_decode_ac,
-	blurhash_error_stbi_write_png
+	blurhash_error_stbi_write_png,
+	blurhash_error_malloc,
+	blurhash_error_invalid_rows,
+	blurhash_error_invalid_format,
+	blurhash_error_invalid_rect,
+	blurhash_error_write,
+	blurhash_error_invalid_index
 };
 typedef enum blurhash_error_t blurhash_error_t;
 
+// blurhash_format_t is the pixel layout accepted by `blurhash_encode_ex`.
+// 16-bit formats are in host byte order, alpha is ignored.
+enum blurhash_format_t {
+	blurhash_format_rgb8,
+	blurhash_format_rgba8,
+	blurhash_format_bgr8,
+	blurhash_format_bgra8,
+	blurhash_format_gray8,
+	blurhash_format_rgb16,
+	blurhash_format_rgba16,
+	blurhash_format_gray16
+};
+typedef enum blurhash_format_t blurhash_format_t;
+
 // BLURHASH_ENCODE_BUFSZ defines maximum buffer size for hash
 #define BLURHASH_ENCODE_BUFSZ (2 + 4 + (9 * 9 - 1) * 2 + 1)
 
@@ -54,6 +74,7 @@ typedef enum blurhash_error_t blurhash_error_t;
 
 /**
  * @brief encodes blurhash from filename to buffer.
+ * Regular files are mapped and decoded in place instead of being read through stdio.
  * @param xComponents range [1, 9]
  * @param yComponents range [1, 9]
  * @param filename valid file path
@@ -62,6 +83,17 @@ typedef enum blurhash_error_t blurhash_error_t;
 */
 blurhash_error_t blurhash_encode_file(int xComponents, int yComponents, const char *filename, char* buffer);
 
+/**
+ * @brief encodes blurhash from an image file already in memory, in any format `stbi_load` reads.
+ * @param xComponents range [1, 9]
+ * @param yComponents range [1, 9]
+ * @param data the bytes of the file
+ * @param size number of bytes, at most `INT_MAX`
+ * @param buffer must >= `BLURHASH_ENCODE_BUFSZ`
+ * @return success is `0`, print others by `blurhash_perror`
+*/
+blurhash_error_t blurhash_encode_memory(int xComponents, int yComponents, const void *data, size_t size, char* buffer);
+
 /**
  * @brief encodes blurhash from rgb image bytes to buffer.
  * @param xComponents range [1, 9]
@@ -75,6 +107,174 @@ blurhash_error_t blurhash_encode_file(int xComponents, int yComponents, const ch
 blurhash_error_t blurhash_encode(int xComponents, int yComponents, int width, int height, const uint8_t *rgb, char* buffer);
 
 
+/**
+ * @brief encodes blurhash from pixels of any `blurhash_format_t` with padded rows to buffer.
+ * The pixels are read in place, no converted copy is made.
+ * @param xComponents range [1, 9]
+ * @param yComponents range [1, 9]
+ * @param width image width pixels
+ * @param height image height pixels
+ * @param format layout of one pixel
+ * @param pixels first byte of the top row
+ * @param bytesPerRow bytes from one row to the next, >= width * pixel size
+ * @param buffer must >= `BLURHASH_ENCODE_BUFSZ`
+ * @return success is `0`, print others by `blurhash_perror`
+*/
+blurhash_error_t blurhash_encode_ex(int xComponents, int yComponents, int width, int height, blurhash_format_t format, const void *pixels, size_t bytesPerRow, char* buffer);
+
+/**
+ * @brief encodes blurhash from rgb image bytes to buffer on several threads.
+ * The rows are split into nthreads bands whose partial sums are added up
+ * before quantisation, so the hash matches `blurhash_encode` within float rounding.
+ * @param xComponents range [1, 9]
+ * @param yComponents range [1, 9]
+ * @param width image width pixels
+ * @param height image height pixels
+ * @param rgb [3][width][height]
+ * @param buffer must >= `BLURHASH_ENCODE_BUFSZ`
+ * @param nthreads number of threads, `0` = all online CPUs
+ * @return success is `0`, print others by `blurhash_perror`
+*/
+blurhash_error_t blurhash_encode_mt(int xComponents, int yComponents, int width, int height, const uint8_t *rgb, char* buffer, int nthreads);
+
+// BLURHASH_FAST_GRID is the long side of the box-averaged grid of `blurhash_encode_fast`
+#define BLURHASH_FAST_GRID 64
+
+/**
+ * @brief encodes an approximate blurhash from rgb image bytes to buffer.
+ * The image is box-averaged in one pass onto a grid of at most `BLURHASH_FAST_GRID`
+ * pixels on the long side, and the coefficients are taken from that grid, so the
+ * cost after reading the pixels no longer depends on the resolution.
+ * Images that already fit the grid are encoded exactly by `blurhash_encode`.
+ * @note Measured against `blurhash_encode` on synthetic gradients, sine patterns and shapes
+ * from 320x240 to 1920x1080 over all 81 component counts, 22% ~ 36% of the hashes differ,
+ * nearly always by one quantisation step of a few AC components (white noise: 87%, up to 3 steps).
+ * @param xComponents range [1, 9]
+ * @param yComponents range [1, 9]
+ * @param width image width pixels
+ * @param height image height pixels
+ * @param rgb [3][width][height]
+ * @param buffer must >= `BLURHASH_ENCODE_BUFSZ`
+ * @return success is `0`, print others by `blurhash_perror`
+*/
+blurhash_error_t blurhash_encode_fast(int xComponents, int yComponents, int width, int height, const uint8_t *rgb, char* buffer);
+
+/**
+ * @brief incremental encoder fed with rows of pixels, see `blurhash_encoder_begin`.
+ * It only keeps the coefficient sums, one row buffer and a cosine table of the width,
+ * so the image never has to be held in memory as a whole.
+*/
+typedef struct blurhash_encoder_t blurhash_encoder_t;
+
+/**
+ * @brief starts an incremental encode of a width x height image.
+ * The encoder holds (xComponents + 3) * width floats, the cosine table and one row of linear rgb,
+ * plus about 1 KB of sums, so its size grows with the width but not with the height.
+ * It is allocated once here, pushing rows allocates nothing.
+ * @param encoder receives the new encoder, release it by `blurhash_encoder_finish` or `blurhash_encoder_free`
+ * @param xComponents range [1, 9]
+ * @param yComponents range [1, 9]
+ * @param width image width pixels
+ * @param height image height pixels
+ * @return success is `0`, print others by `blurhash_perror`
+*/
+blurhash_error_t blurhash_encoder_begin(blurhash_encoder_t **encoder, int xComponents, int yComponents, int width, int height);
+
+/**
+ * @brief feeds the next rows of the image, top to bottom.
+ * @param encoder from `blurhash_encoder_begin`
+ * @param rows [3][width][count] rgb pixels
+ * @param count number of rows, the total must not exceed height
+ * @param stride bytes from one row to the next, >= width * 3
+ * @return success is `0`, print others by `blurhash_perror`
+*/
+blurhash_error_t blurhash_encoder_push_rows(blurhash_encoder_t *encoder, const uint8_t *rows, int count, size_t stride);
+
+/**
+ * @brief writes the hash of all pushed rows to buffer and frees the encoder.
+ * @param encoder from `blurhash_encoder_begin`, invalid after the call
+ * @param buffer must >= `BLURHASH_ENCODE_BUFSZ`
+ * @return success is `0`, `blurhash_error_invalid_rows` if fewer than height rows were pushed
+*/
+blurhash_error_t blurhash_encoder_finish(blurhash_encoder_t *encoder, char* buffer);
+
+/**
+ * @brief frees an encoder without finishing it.
+ * @param encoder from `blurhash_encoder_begin`, invalid after the call
+*/
+void blurhash_encoder_free(blurhash_encoder_t *encoder);
+
+/**
+ * @brief an encoded image whose coefficient sums are kept for edits, see `blurhash_encode_state`.
+ * The sums are unquantised and held in double, so any number of `blurhash_state_update_region`
+ * calls do not drift from a fresh encode of the edited image.
+*/
+typedef struct blurhash_state_t blurhash_state_t;
+
+/**
+ * @brief encodes pixels like `blurhash_encode_ex` and keeps the coefficient sums in a state.
+ * @param state receives the new state, release it by `blurhash_state_free`
+ * @param xComponents range [1, 9]
+ * @param yComponents range [1, 9]
+ * @param width image width pixels
+ * @param height image height pixels
+ * @param format layout of pixels, kept for the updates
+ * @param pixels top-left pixel of the image
+ * @param bytesPerRow bytes from one row of pixels to the next
+ * @param buffer must >= `BLURHASH_ENCODE_BUFSZ`
+ * @return success is `0`, print others by `blurhash_perror`
+*/
+blurhash_error_t blurhash_encode_state(blurhash_state_t **state, int xComponents, int yComponents, int width, int height, blurhash_format_t format, const void *pixels, size_t bytesPerRow, char* buffer);
+
+/**
+ * @brief replaces the rectangle [x0, x0 + width) x [y0, y0 + height) of the image and re-hashes it.
+ * Only the difference of the old and new pixels is accumulated, so the cost scales with the rectangle.
+ * @param state from `blurhash_encode_state`
+ * @param x0 left column of the rectangle
+ * @param y0 top row of the rectangle
+ * @param width of the rectangle
+ * @param height of the rectangle
+ * @param oldPixels top-left pixel of the rectangle before the edit, in the format of the state
+ * @param oldBytesPerRow bytes from one row of oldPixels to the next
+ * @param newPixels top-left pixel of the rectangle after the edit, in the format of the state
+ * @param newBytesPerRow bytes from one row of newPixels to the next
+ * @param buffer receives the hash of the edited image, must >= `BLURHASH_ENCODE_BUFSZ`
+ * @return success is `0`, print others by `blurhash_perror`
+*/
+blurhash_error_t blurhash_state_update_region(blurhash_state_t *state, int x0, int y0, int width, int height, const void *oldPixels, size_t oldBytesPerRow, const void *newPixels, size_t newBytesPerRow, char* buffer);
+
+/**
+ * @brief frees a state.
+ * @param state from `blurhash_encode_state`, invalid after the call
+*/
+void blurhash_state_free(blurhash_state_t *state);
+
+/**
+ * @brief one image of `blurhash_encode_batch`.
+ * Set either `filename`, or `rgb` with `width` and `height`;
+ * `hash` and `err` are filled in by the call.
+*/
+typedef struct blurhash_batch_item_t {
+	const char *filename; // valid file path, or NULL to use rgb
+	const uint8_t *rgb; // [3][width][height]
+	int width, height; // image pixels of rgb
+	char hash[BLURHASH_ENCODE_BUFSZ]; // resulting hash when err is `0`
+	blurhash_error_t err; // result of this item, print by `blurhash_perror`
+} blurhash_batch_item_t;
+
+/**
+ * @brief encodes many images on a work-stealing thread pool.
+ * Each worker starts on its own slice of items and steals from the others once it runs dry,
+ * so slow file loads do not leave threads idle. Scratch memory is reused across items.
+ * @param xComponents range [1, 9]
+ * @param yComponents range [1, 9]
+ * @param items images to encode, results are stored per item
+ * @param n number of items
+ * @param nthreads number of threads, `0` = all online CPUs
+ * @return `0` when all items have been processed, otherwise the error applies to the whole batch
+*/
+blurhash_error_t blurhash_encode_batch(int xComponents, int yComponents, blurhash_batch_item_t *items, size_t n, int nthreads);
+
 /**
  * @brief decodes the blurhash and copies the pixels to buffer.
  * @param blurhash a string representing the blurhash to be decoded
@@ -87,6 +287,97 @@ blurhash_error_t blurhash_encode(int xComponents, int yComponents, int width, in
 */
 blurhash_error_t blurhash_decode(const char * blurhash, int width, int height, int punch, int nChannels, uint8_t* buffer);
 
+/**
+ * @brief decodes the blurhash and copies the pixels to buffer on several threads.
+ * The rows are split into nthreads bands sharing the parsed coefficients and
+ * basis tables, each written straight into its own rows of buffer,
+ * so the pixels are identical to `blurhash_decode`.
+ * @param blurhash a string representing the blurhash to be decoded
+ * @param width of the resulting image
+ * @param height of the resulting image
+ * @param punch the factor to improve the contrast, default = 1
+ * @param nChannels number of channels in the resulting image array, 3 = RGB, 4 = RGBA
+ * @param buffer must >= `BLURHASH_DECODE_BUFSZ`
+ * @param nthreads number of threads, `0` = all online CPUs
+ * @return success is `0`, print others by `blurhash_perror`
+*/
+blurhash_error_t blurhash_decode_mt(const char * blurhash, int width, int height, int punch, int nChannels, uint8_t* buffer, int nthreads);
+
+/**
+ * @brief the parsed colour coefficients of a blurhash, see `blurhash_parse`.
+*/
+typedef struct blurhash_coeffs_t {
+	int numX, numY; // components in each direction, range [1, 9]
+	float colors[9 * 9][3]; // linear rgb of component (i, j) at [i + j * numX], punch applied
+} blurhash_coeffs_t;
+
+/**
+ * @brief validates and parses the blurhash once, for any number of `blurhash_render_rect` calls.
+ * @param blurhash a string representing the blurhash to be decoded
+ * @param punch the factor to improve the contrast, default = 1
+ * @param coeffs receives the coefficients
+ * @return success is `0`, print others by `blurhash_perror`
+*/
+blurhash_error_t blurhash_parse(const char * blurhash, int punch, blurhash_coeffs_t *coeffs);
+
+/**
+ * @brief renders the sub-rectangle [x0, x0 + width) x [y0, y0 + height) of the fullWidth x fullHeight image into buffer.
+ * Tiles rendered this way are identical to the same pixels of a full `blurhash_decode`.
+ * @param coeffs from `blurhash_parse`
+ * @param fullWidth width of the whole virtual image
+ * @param fullHeight height of the whole virtual image
+ * @param x0 left column of the rectangle
+ * @param y0 top row of the rectangle
+ * @param width of the rectangle
+ * @param height of the rectangle
+ * @param nChannels number of channels in the resulting image array, 3 = RGB, 4 = RGBA
+ * @param bytesPerRow bytes from one row of buffer to the next, >= width * nChannels
+ * @param buffer receives the top-left pixel of the rectangle at buffer[0]
+ * @return success is `0`, print others by `blurhash_perror`
+*/
+blurhash_error_t blurhash_render_rect(const blurhash_coeffs_t *coeffs, int fullWidth, int fullHeight, int x0, int y0, int width, int height, int nChannels, size_t bytesPerRow, uint8_t* buffer);
+
+// BLURHASH_FAST_DECODE_SAMPLES is the number of grid points per component of `blurhash_decode_fast`
+#define BLURHASH_FAST_DECODE_SAMPLES 16
+
+/**
+ * @brief decodes an approximation of the blurhash into buffer.
+ * The exact basis is evaluated on a grid of `BLURHASH_FAST_DECODE_SAMPLES` points per component
+ * along each axis, converted to sRGB and upscaled bilinearly, so large outputs mostly cost
+ * one interpolation per channel. Outputs no larger than the grid are decoded exactly.
+ * @note Against `blurhash_decode` from 100x75 to 1920x1080, 99.4% of the channels are within 1.
+ * The largest errors sit where the exact image clips to black: at most 18 for hashes of
+ * photo-like images, and 36 for hashes of white noise.
+ * @param blurhash a string representing the blurhash to be decoded
+ * @param width of the resulting image
+ * @param height of the resulting image
+ * @param punch the factor to improve the contrast, default = 1
+ * @param nChannels number of channels in the resulting image array, 3 = RGB, 4 = RGBA
+ * @param buffer must >= `BLURHASH_DECODE_BUFSZ`
+ * @return success is `0`, print others by `blurhash_perror`
+*/
+blurhash_error_t blurhash_decode_fast(const char * blurhash, int width, int height, int punch, int nChannels, uint8_t* buffer);
+
+/**
+ * @brief decodes the blurhash into buffer with integer arithmetic only.
+ * Coefficients and pixels are in fixed point, the cosines in Q14 from a constant table, and
+ * linear values map to sRGB through a constant table, so the output is bit-identical on every
+ * platform, compiler and optimisation level.
+ * In `blurhash_bench` it is 1.4x ~ 2.3x as fast as `blurhash_decode` from 320x240 to 1920x1080,
+ * most on small outputs with few components and 1.4x ~ 1.6x at 1920x1080.
+ * @note The output stays within 1 of `blurhash_decode`, which `blurhash_golden` checks on 60 hashes
+ * of 1x1 to 9x9 components, punch 1 and 2, from 32x32 to 1920x1080, where 99.61% of the channels
+ * are identical. The differences come from the Q14 cosines and the rounding of the colours of a row.
+ * @param blurhash a string representing the blurhash to be decoded
+ * @param width of the resulting image
+ * @param height of the resulting image
+ * @param punch the factor to improve the contrast, default = 1
+ * @param nChannels number of channels in the resulting image array, 3 = RGB, 4 = RGBA
+ * @param buffer must >= `BLURHASH_DECODE_BUFSZ`
+ * @return success is `0`, print others by `blurhash_perror`
+*/
+blurhash_error_t blurhash_decode_fixed(const char * blurhash, int width, int height, int punch, int nChannels, uint8_t* buffer);
+
 /**
  * @brief decodes the blurhash into filename.
  * @param blurhash a string representing the blurhash to be decoded
@@ -100,33 +391,404 @@ blurhash_error_t blurhash_decode(const char * blurhash, int width, int height, i
 */
 blurhash_error_t blurhash_decode_file(const char* blurhash, int width, int height, int punch, int nChannels, const char *filename, uint8_t* buffer);
 
+// blurhash_file_format_t is the image file format written by `blurhash_decode_fd`
+enum blurhash_file_format_t {
+	blurhash_file_format_png,
+	blurhash_file_format_ppm, // binary PPM (P6), always RGB
+	blurhash_file_format_pam, // PAM (P7), RGB or RGB_ALPHA
+	blurhash_file_format_raw, // the pixels only, no header
+	blurhash_file_format_qoi // the Quite OK Image format
+};
+typedef enum blurhash_file_format_t blurhash_file_format_t;
+
+// BLURHASH_PNG_LEVEL_DEFAULT is the zlib level of stb_image_write
+#define BLURHASH_PNG_LEVEL_DEFAULT 8
+
+/**
+ * @brief decodes the blurhash into an image file written to fd, without a caller buffer.
+ * Rows are rendered and written a band of about 64 KiB at a time, except for PNG at a pngLevel
+ * above `0`, which is compressed by `stbi_write_png` from a whole image held internally.
+ * PNG at level `0` is streamed as stored (uncompressed) deflate blocks.
+ * @param blurhash a string representing the blurhash to be decoded
+ * @param width of the resulting image
+ * @param height of the resulting image
+ * @param punch the factor to improve the contrast, default = 1
+ * @param nChannels 3 = RGB, 4 = RGBA, ignored by `blurhash_file_format_ppm`
+ * @param format of the file
+ * @param pngLevel zlib level [0, 9] of `blurhash_file_format_png`, see `BLURHASH_PNG_LEVEL_DEFAULT`
+ * @param fd open for writing, it is not closed
+ * @return success is `0`, print others by `blurhash_perror`
+*/
+blurhash_error_t blurhash_decode_fd(const char* blurhash, int width, int height, int punch, int nChannels, blurhash_file_format_t format, int pngLevel, int fd);
+
+/**
+ * @brief `blurhash_decode_fd` into filename, which is created or truncated only once the arguments and blurhash are valid.
+ * @param blurhash a string representing the blurhash to be decoded
+ * @param width of the resulting image
+ * @param height of the resulting image
+ * @param punch the factor to improve the contrast, default = 1
+ * @param nChannels 3 = RGB, 4 = RGBA, ignored by `blurhash_file_format_ppm`
+ * @param format of the file
+ * @param pngLevel zlib level [0, 9] of `blurhash_file_format_png`, see `BLURHASH_PNG_LEVEL_DEFAULT`
+ * @param filename valid file path
+ * @return success is `0`, print others by `blurhash_perror`
+*/
+blurhash_error_t blurhash_decode_file_ex(const char* blurhash, int width, int height, int punch, int nChannels, blurhash_file_format_t format, int pngLevel, const char *filename);
+
+/**
+ * @brief a thread-safe LRU cache of decoded images keyed by (blurhash, width, height, punch, nChannels).
+ * It is split into shards by key, each with its own lock. The memory budget is shared, so one image
+ * may take all of it: an insertion evicts from its own shard first, then from the others.
+ * Images are handed out as refcounted read-only buffers, so an evicted image stays
+ * valid until its last holder releases it.
+*/
+typedef struct blurhash_cache_t blurhash_cache_t;
+
+/**
+ * @brief counters of a `blurhash_cache_t`, summed over all shards.
+*/
+typedef struct blurhash_cache_stats_t {
+	uint64_t hits; // lookups served from the cache
+	uint64_t misses; // lookups that had to decode
+	uint64_t evictions; // images dropped to stay within the budget
+	uint64_t oversized; // lookups of images larger than the whole budget, decoded but never kept, not counted as misses
+	size_t entries; // images held now
+	size_t bytes; // memory held now, including per-image overhead
+	size_t budget; // maximum of bytes
+} blurhash_cache_stats_t;
+
+/**
+ * @brief creates an empty cache.
+ * @param cache receives the new cache, release it by `blurhash_cache_free`
+ * @param budget maximum bytes of cached images; an image larger than all of it
+ * is decoded for its caller but not kept, see `blurhash_cache_stats_t.oversized`
+ * @return success is `0`, print others by `blurhash_perror`
+*/
+blurhash_error_t blurhash_cache_create(blurhash_cache_t **cache, size_t budget);
+
+/**
+ * @brief frees the cache. Images still held are freed by their last `blurhash_cache_release`.
+ * @param cache from `blurhash_cache_create`, invalid after the call
+*/
+void blurhash_cache_free(blurhash_cache_t *cache);
+
+/**
+ * @brief looks up the decoded image, decoding and inserting it on a miss.
+ * @param cache from `blurhash_cache_create`
+ * @param blurhash a string representing the blurhash to be decoded
+ * @param width of the resulting image
+ * @param height of the resulting image
+ * @param punch the factor to improve the contrast, default = 1
+ * @param nChannels number of channels in the resulting image array, 3 = RGB, 4 = RGBA
+ * @param pixels receives [nChannels][width][height] read-only pixels, release them by `blurhash_cache_release`
+ * @return success is `0`, print others by `blurhash_perror`
+*/
+blurhash_error_t blurhash_cache_get(blurhash_cache_t *cache, const char * blurhash, int width, int height, int punch, int nChannels, const uint8_t **pixels);
+
+/**
+ * @brief drops one reference to pixels returned by `blurhash_cache_get`.
+ * @param pixels from `blurhash_cache_get`, invalid after the call
+*/
+void blurhash_cache_release(const uint8_t *pixels);
+
+/**
+ * @brief reads the counters of the cache.
+ * @param cache from `blurhash_cache_create`
+ * @param stats receives the counters
+*/
+void blurhash_cache_get_stats(blurhash_cache_t *cache, blurhash_cache_stats_t *stats);
+
+/**
+ * @brief reusable scratch memory for repeated encodes and decodes on one thread.
+ * It keeps the cosine basis tables of the last `BLURHASH_CTX_TABLES` image sides it has seen,
+ * so calls at a known size do no trigonometry and no allocation. A context must not be used
+ * by two threads at once; give each thread its own.
+*/
+typedef struct blurhash_ctx_t blurhash_ctx_t;
+
+// BLURHASH_CTX_TABLES is the number of image sides whose basis tables a `blurhash_ctx_t` keeps
+#define BLURHASH_CTX_TABLES 8
+
+/**
+ * @brief creates an empty context.
+ * @param ctx receives the context
+ * @return success is `0`, print others by `blurhash_perror`
+*/
+blurhash_error_t blurhash_ctx_create(blurhash_ctx_t **ctx);
+
+/**
+ * @brief frees the context and all of its tables.
+ * @param ctx from `blurhash_ctx_create`, invalid after the call
+*/
+void blurhash_ctx_free(blurhash_ctx_t *ctx);
+
+/**
+ * @brief `blurhash_encode_ex` taking its tables and scratch memory from ctx.
+ * @param ctx from `blurhash_ctx_create`
+ * @param xComponents range [1, 9]
+ * @param yComponents range [1, 9]
+ * @param width of the image
+ * @param height of the image
+ * @param format of the pixels
+ * @param pixels the image
+ * @param bytesPerRow from the start of one row to the next
+ * @param buffer must >= `BLURHASH_ENCODE_BUFSZ`
+ * @return success is `0`, print others by `blurhash_perror`
+*/
+blurhash_error_t blurhash_encode_ctx(blurhash_ctx_t *ctx, int xComponents, int yComponents, int width, int height, blurhash_format_t format, const void *pixels, size_t bytesPerRow, char* buffer);
+
+/**
+ * @brief `blurhash_decode` taking its tables and scratch memory from ctx.
+ * @param ctx from `blurhash_ctx_create`
+ * @param blurhash a string representing the blurhash to be decoded
+ * @param width of the resulting image
+ * @param height of the resulting image
+ * @param punch the factor to improve the contrast, default = 1
+ * @param nChannels number of channels in the resulting image array, 3 = RGB, 4 = RGBA
+ * @param buffer must >= `BLURHASH_DECODE_BUFSZ`
+ * @return success is `0`, print others by `blurhash_perror`
+*/
+blurhash_error_t blurhash_decode_ctx(blurhash_ctx_t *ctx, const char * blurhash, int width, int height, int punch, int nChannels, uint8_t* buffer);
+
+
+// blurhash_stats_op_t is the kind of call counted by the stats
+enum blurhash_stats_op_t {
+	blurhash_stats_op_encode,
+	blurhash_stats_op_decode,
+	blurhash_stats_op_count
+};
+typedef enum blurhash_stats_op_t blurhash_stats_op_t;
+
+// blurhash_stats_stage_t is a part of a call timed by the stats
+enum blurhash_stats_stage_t {
+	blurhash_stats_stage_load, // reading and decoding the image file of an encode
+	blurhash_stats_stage_accumulate, // basis sums over the pixels
+	blurhash_stats_stage_quantise, // quantisation and base83 of the hash
+	blurhash_stats_stage_parse, // base83 and coefficients of the hash
+	blurhash_stats_stage_render, // pixels from the coefficients
+	blurhash_stats_stage_write, // encoding and writing the image file of a decode
+	blurhash_stats_stage_count
+};
+typedef enum blurhash_stats_stage_t blurhash_stats_stage_t;
+
+// BLURHASH_STATS_BUCKETS is the number of latency histogram buckets, bucket k counting calls of [2^k, 2^(k+1)) ns
+#define BLURHASH_STATS_BUCKETS 40
+
+/**
+ * @brief stats of one encode or decode call, see `blurhash_stats_last_call`.
+ * Nested calls, such as the `blurhash_encode` inside `blurhash_encode_file`, are part of the outer one.
+*/
+typedef struct blurhash_call_stats_t {
+	blurhash_stats_op_t op;
+	blurhash_error_t err; // result of the call
+	uint64_t pixels; // pixels of the image read or written
+	uint64_t bytes; // bytes of the pixels read or written
+	uint64_t ns; // whole call
+	uint64_t stageNs[blurhash_stats_stage_count]; // per stage, the rest is set-up
+} blurhash_call_stats_t;
+
+/**
+ * @brief process-wide stats, summed over all threads since the stats were enabled or reset.
+*/
+typedef struct blurhash_stats_t {
+	uint64_t calls[blurhash_stats_op_count];
+	uint64_t errors[blurhash_stats_op_count];
+	uint64_t pixels[blurhash_stats_op_count];
+	uint64_t bytes[blurhash_stats_op_count];
+	uint64_t ns[blurhash_stats_op_count];
+	uint64_t stageNs[blurhash_stats_stage_count];
+	uint64_t histogram[blurhash_stats_op_count][BLURHASH_STATS_BUCKETS]; // latency of whole calls
+} blurhash_stats_t;
+
+/**
+ * @brief turns the collection of stats on or off for all threads, off by default.
+ * While off, each call only pays one load of a flag; build with `BLURHASH_NO_STATS` to remove even that.
+ * @param enable `true` to collect
+*/
+void blurhash_stats_enable(bool enable);
+
+/**
+ * @brief reads the process-wide stats.
+ * @param stats receives the counters
+*/
+void blurhash_stats_get(blurhash_stats_t *stats);
+
+/**
+ * @brief sets the process-wide stats to zero.
+*/
+void blurhash_stats_reset(void);
+
+/**
+ * @brief reads the stats of the last call completed on the calling thread while stats were enabled.
+ * @param stats receives the stats of the call
+ * @return bool (`true` if there was such a call, else `false`)
+*/
+bool blurhash_stats_last_call(blurhash_call_stats_t *stats);
+
+// BLURHASH_FEATURE_DIMS is the length of a `blurhash_feature` vector: 4 x 4 components of 3 channels
+#define BLURHASH_FEATURE_DIMS 48
+
+/**
+ * @brief converts the blurhash into a feature vector for similarity search.
+ * Entry (j * 4 + i) * 3 + c is channel c of the linear rgb component (i, j) scaled by 254, the DC offset by -127,
+ * so the Euclidean distance of two vectors measures how far apart the two placeholders look.
+ * Components beyond 4 x 4 are dropped and missing ones are `0`.
+ * @param blurhash a string representing the blurhash
+ * @param feature receives `BLURHASH_FEATURE_DIMS` values
+ * @return success is `0`, print others by `blurhash_perror`
+*/
+blurhash_error_t blurhash_feature(const char * blurhash, int8_t *feature);
+
+/**
+ * @brief a read-only similarity index over the features of many blurhashes, see `blurhash_index_open`.
+ * It is a vantage-point tree laid out in one file of 64 bytes per hash, queried in place through mmap,
+ * so opening it costs nothing and only the pages a query visits are read.
+ * An index may be shared by any number of threads.
+*/
+typedef struct blurhash_index_t blurhash_index_t;
+
+/**
+ * @brief builds an index file from blurhashes added one at a time, see `blurhash_index_writer_begin`.
+*/
+typedef struct blurhash_index_writer_t blurhash_index_writer_t;
+
+/**
+ * @brief one result of an index query.
+*/
+typedef struct blurhash_match_t {
+	uint64_t id; // given to `blurhash_index_writer_add`
+	float distance; // Euclidean distance of the features
+} blurhash_match_t;
+
+/**
+ * @brief starts writing an index to filename, which is created or truncated.
+ * @param writer receives the new writer, release it by `blurhash_index_writer_finish` or `blurhash_index_writer_free`
+ * @param filename valid file path
+ * @return success is `0`, print others by `blurhash_perror`
+*/
+blurhash_error_t blurhash_index_writer_begin(blurhash_index_writer_t **writer, const char *filename);
+
+/**
+ * @brief appends one blurhash to the index. The features are streamed to the file, not kept in memory.
+ * @param writer from `blurhash_index_writer_begin`
+ * @param blurhash a string representing the blurhash
+ * @param id returned by the queries that match this hash
+ * @return success is `0`, invalid hashes are not added
+*/
+blurhash_error_t blurhash_index_writer_add(blurhash_index_writer_t *writer, const char * blurhash, uint64_t id);
+
+/**
+ * @brief arranges the added hashes into the tree in place, through mmap of the file, and frees the writer.
+ * @param writer from `blurhash_index_writer_begin`, invalid after the call
+ * @param nthreads number of threads, `0` = all online CPUs
+ * @return success is `0`, print others by `blurhash_perror`
+*/
+blurhash_error_t blurhash_index_writer_finish(blurhash_index_writer_t *writer, int nthreads);
+
+/**
+ * @brief frees a writer without finishing it, leaving an invalid index file behind.
+ * @param writer from `blurhash_index_writer_begin`, invalid after the call
+*/
+void blurhash_index_writer_free(blurhash_index_writer_t *writer);
+
+/**
+ * @brief maps an index file written by `blurhash_index_writer_finish`.
+ * @param index receives the index, release it by `blurhash_index_close`
+ * @param filename valid file path
+ * @return success is `0`, `blurhash_error_invalid_index` if the file is not an index
+*/
+blurhash_error_t blurhash_index_open(blurhash_index_t **index, const char *filename);
+
+/**
+ * @brief unmaps the index.
+ * @param index from `blurhash_index_open`, invalid after the call
+*/
+void blurhash_index_close(blurhash_index_t *index);
+
+/**
+ * @brief the number of hashes in the index.
+ * @param index from `blurhash_index_open`
+ * @return count of hashes
+*/
+uint64_t blurhash_index_size(const blurhash_index_t *index);
+
+/**
+ * @brief finds the k hashes of the index nearest to feature.
+ * @param index from `blurhash_index_open`
+ * @param feature from `blurhash_feature`
+ * @param k number of neighbours wanted
+ * @param matches receives up to k matches, nearest first
+ * @param count receives the number of matches, less than k only if the index is smaller
+ * @return success is `0`, print others by `blurhash_perror`
+*/
+blurhash_error_t blurhash_index_knn(const blurhash_index_t *index, const int8_t *feature, size_t k, blurhash_match_t *matches, size_t *count);
+
+/**
+ * @brief finds the hashes of the index within radius of feature.
+ * @param index from `blurhash_index_open`
+ * @param feature from `blurhash_feature`
+ * @param radius largest distance included
+ * @param matches receives up to capacity matches, in no particular order
+ * @param capacity length of matches
+ * @param count receives the number of hashes within radius, which may exceed capacity
+ * @return success is `0`, print others by `blurhash_perror`
+*/
+blurhash_error_t blurhash_index_radius(const blurhash_index_t *index, const int8_t *feature, float radius, blurhash_match_t *matches, size_t capacity, size_t *count);
 
 /**
  * @brief checks if the blurhash is valid or not.
- * @param blurhash astring representing the blurhash
+ * A valid blurhash has a size flag of at most 9x9 components, the length that flag implies
+ * and only characters of the base83 alphabet.
+ * @param blurhash astring representing the blurhash, may be NULL
  * @return bool (`true` if it is a valid blurhash, else `false`)
 */
 bool blurhash_is_valid(const char * blurhash);
 
+/**
+ * @brief checks many blurhashes at once, each as `blurhash_is_valid` does,
+ * with the alphabet check done on whole vectors of characters.
+ * @param hashes n strings representing blurhashes, entries may be NULL
+ * @param n number of hashes
+ * @param results receives n flags, `1` if the hash is valid, else `0`
+ * @return the number of valid hashes
+*/
+size_t blurhash_validate_batch(const char ** hashes, size_t n, uint8_t * results);
+
+/**
+ * @brief get the name of an error
+ * @param err the error
+ * @return a static string such as `"blurhash_error_invalid_hash"`
+*/
+static inline const char *blurhash_strerror(blurhash_error_t err) {
+	#define blurhash_strerror_case(n) case blurhash_error_##n: return "blurhash_error_"#n
+		switch(err) {
+			blurhash_strerror_case(ok);
+			blurhash_strerror_case(invalid_x_components);
+			blurhash_strerror_case(invalid_y_components);
+			blurhash_strerror_case(stbi_load);
+			blurhash_strerror_case(invalid_hash);
+			blurhash_strerror_case(invalid_decode_quantized_max_value);
+			blurhash_strerror_case(invalid_decode_dc);
+			blurhash_strerror_case(invalid_decode_ac);
+			blurhash_strerror_case(stbi_write_png);
+			blurhash_strerror_case(malloc);
+			blurhash_strerror_case(invalid_rows);
+			blurhash_strerror_case(invalid_format);
+			blurhash_strerror_case(invalid_rect);
+			blurhash_strerror_case(write);
+			blurhash_strerror_case(invalid_index);
+			default: return "blurhash";
+		}
+	#undef blurhash_strerror_case
+}
+
 /**
  * @brief call perror on error
  * @param err the error
  * @return the input parameter `err`
 */
 static inline blurhash_error_t blurhash_perror(blurhash_error_t err) {
-	#define blurhash_perror_case(n) case blurhash_error_##n: perror("blurhash_error_"#n)
-		if(err) switch(err) {
-			blurhash_perror_case(invalid_x_components); break;
-			blurhash_perror_case(invalid_y_components); break;
-			blurhash_perror_case(stbi_load); break;
-			blurhash_perror_case(invalid_hash); break;
-			blurhash_perror_case(invalid_decode_quantized_max_value); break;
-			blurhash_perror_case(invalid_decode_dc); break;
-			blurhash_perror_case(invalid_decode_ac); break;
-			blurhash_perror_case(stbi_write_png); break;
-			default: perror("blurhash"); break;
-		}
-	#undef blurhash_perror_case
+	if(err) perror(blurhash_strerror(err));
 	return err;
 }
 
@@ -0,0 +1,398 @@
+#ifndef __BLURHASH_BLURHASH_HPP__
+#define __BLURHASH_BLURHASH_HPP__
+
+/* blurhash.hpp
+ * This file is part of the blurhash distribution (https://github.com/fumiama/blurhash).
+ * Copyright (c) 2018 Wolt Enterprises and Copyright (c) 2025 Fumiama Minamoto.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+// Header-only C++20 encoder and decoder. Every component loop runs over compile-time X and Y, so it is
+// unrolled and all coefficients live in fixed-size arrays on the stack; nothing here allocates.
+// The runtime encode and decode pick one of the 81 instantiations from a dispatch table.
+// The results match those of the C library to within one quantisation step or one 8-bit level.
+
+#include <array>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string_view>
+#include <utility>
+
+extern "C" {
+#include "blurhash.h"
+}
+
+namespace blurhash {
+
+// hash_length<X, Y> is the number of characters of a hash of X x Y components
+template<int X, int Y> inline constexpr std::size_t hash_length = 4 + 2 * X * Y;
+
+// hash_t<X, Y> is a NUL-terminated hash of X x Y components
+template<int X, int Y> using hash_t = std::array<char, hash_length<X, Y> + 1>;
+
+// any_hash_t is a NUL-terminated hash of any number of components
+using any_hash_t = std::array<char, BLURHASH_ENCODE_BUFSZ>;
+
+// image_view is read-only 8-bit RGB (channels = 3) or RGBA (channels = 4, alpha ignored) pixels,
+// row y starting at pixels[y * stride]
+struct image_view {
+	std::span<const std::uint8_t> pixels;
+	int width, height;
+	std::size_t stride;
+	int channels = 3;
+};
+
+// image_span is 8-bit RGB (channels = 3) or RGBA (channels = 4, alpha = 255) pixels to be written,
+// row y starting at pixels[y * stride]
+struct image_span {
+	std::span<std::uint8_t> pixels;
+	int width, height;
+	std::size_t stride;
+	int channels = 4;
+};
+
+// result is value when err is `blurhash_error_ok`
+template<class T> struct result {
+	blurhash_error_t err;
+	T value;
+	explicit operator bool() const { return err == blurhash_error_ok; }
+};
+
+// coefficients are the parsed colours of a hash, colors[j * x + i] being component (i, j)
+struct coefficients {
+	int x, y;
+	std::array<std::array<float, 3>, 81> colors;
+};
+
+namespace detail {
+
+inline constexpr char base83[] = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz#$%*+,-.:;=?@[]^_{|}~";
+
+// TILE is the number of columns whose basis values are kept on the stack at a time
+inline constexpr int TILE = 256;
+// LINEAR_TABLE_SIZE is the number of intervals [0, 1] is split into for linear to sRGB
+inline constexpr int LINEAR_TABLE_SIZE = 4096;
+
+// tables: the same conversion tables as the C library, built on first use
+struct tables {
+	float srgb_to_linear[256];
+	float linear_to_srgb[LINEAR_TABLE_SIZE + 2];
+	std::int8_t base83_reverse[256];
+
+	tables() {
+		for(int i = 0; i < 256; i++) {
+			float v = (float)i / 255;
+			if(v <= 0.04045) srgb_to_linear[i] = v / 12.92;
+			else srgb_to_linear[i] = powf((v + 0.055) / 1.055, 2.4);
+		}
+		for(int i = 0; i <= LINEAR_TABLE_SIZE; i++) {
+			float v = (float)i / LINEAR_TABLE_SIZE;
+			if(v <= 0.0031308) linear_to_srgb[i] = v * 12.92 * 255;
+			else linear_to_srgb[i] = (1.055 * powf(v, 1 / 2.4) - 0.055) * 255;
+		}
+		linear_to_srgb[LINEAR_TABLE_SIZE + 1] = linear_to_srgb[LINEAR_TABLE_SIZE];
+		for(int i = 0; i < 256; i++) base83_reverse[i] = -1;
+		for(int i = 0; i < 83; i++) base83_reverse[(std::uint8_t)base83[i]] = i;
+	}
+
+	static const tables &get() {
+		static const tables instance;
+		return instance;
+	}
+};
+
+inline float basis(int i, int p, int n) {
+	return cosf(M_PI * i * p / n);
+}
+
+inline int linear_to_srgb(const tables &t, float value) {
+	float v = fmaxf(0, fminf(1, value)) * LINEAR_TABLE_SIZE;
+	int i = (int)v;
+	float lo = t.linear_to_srgb[i], hi = t.linear_to_srgb[i + 1];
+	return lo + (v - i) * (hi - lo) + 0.5;
+}
+
+inline float sign_pow(float value, float exp) {
+	return copysignf(powf(fabsf(value), exp), value);
+}
+
+inline char *encode_int(int value, int length, char *destination) {
+	int divisor = 1;
+	for(int i = 0; i < length - 1; i++) divisor *= 83;
+	for(int i = 0; i < length; i++) {
+		*destination++ = base83[(value / divisor) % 83];
+		divisor /= 83;
+	}
+	return destination;
+}
+
+inline int decode_int(const tables &t, std::string_view s, int start, int end) {
+	int value = 0;
+	for(int i = start; i < end; i++) {
+		int digit = t.base83_reverse[(std::uint8_t)s[i]];
+		if(digit < 0) return -1;
+		value = value * 83 + digit;
+	}
+	return value;
+}
+
+inline blurhash_error_t invalid(blurhash_error_t err) {
+	errno = EINVAL;
+	return err;
+}
+
+inline blurhash_error_t check_image(std::size_t size, int width, int height, std::size_t stride, int channels) {
+	if(channels != 3 && channels != 4) return invalid(blurhash_error_invalid_format);
+	if(width <= 0 || height <= 0 || stride < (std::size_t)width * channels) return invalid(blurhash_error_invalid_rect);
+	if(size < stride * (height - 1) + (std::size_t)width * channels) return invalid(blurhash_error_invalid_rect);
+	return blurhash_error_ok;
+}
+
+// factors<X, Y>: the unscaled basis sums of image, [Y][X][3], a tile of columns at a time
+template<int X, int Y> std::array<float, X * Y * 3> factors(const tables &t, const image_view &image) {
+	std::array<float, X * Y * 3> f{};
+	float cos_x[X][TILE], linear[3][TILE];
+	for(int x0 = 0; x0 < image.width; x0 += TILE) {
+		int n = image.width - x0 < TILE ? image.width - x0 : TILE;
+		for(int i = 0; i < X; i++) {
+			for(int k = 0; k < n; k++) cos_x[i][k] = basis(i, x0 + k, image.width);
+		}
+		for(int y = 0; y < image.height; y++) {
+			const std::uint8_t *row = image.pixels.data() + y * image.stride + (std::size_t)x0 * image.channels;
+			for(int k = 0; k < n; k++) {
+				linear[0][k] = t.srgb_to_linear[row[k * image.channels + 0]];
+				linear[1][k] = t.srgb_to_linear[row[k * image.channels + 1]];
+				linear[2][k] = t.srgb_to_linear[row[k * image.channels + 2]];
+			}
+			float sums[X][3] = {};
+			for(int i = 0; i < X; i++) {
+				for(int k = 0; k < n; k++) {
+					sums[i][0] += cos_x[i][k] * linear[0][k];
+					sums[i][1] += cos_x[i][k] * linear[1][k];
+					sums[i][2] += cos_x[i][k] * linear[2][k];
+				}
+			}
+			for(int j = 0; j < Y; j++) {
+				float b = basis(j, y, image.height);
+				for(int i = 0; i < X; i++) {
+					f[(j * X + i) * 3 + 0] += b * sums[i][0];
+					f[(j * X + i) * 3 + 1] += b * sums[i][1];
+					f[(j * X + i) * 3 + 2] += b * sums[i][2];
+				}
+			}
+		}
+	}
+	return f;
+}
+
+// quantise<X, Y>: normalises f and writes the hash, as encodeFactors of the C library
+template<int X, int Y> void quantise(const tables &t, std::array<float, X * Y * 3> &f, int width, int height, char *hash) {
+	for(int j = 0; j < Y; j++) {
+		for(int i = 0; i < X; i++) {
+			float scale = (i == 0 && j == 0 ? 1 : 2) / ((float)width * height);
+			for(int c = 0; c < 3; c++) f[(j * X + i) * 3 + c] *= scale;
+		}
+	}
+
+	char *p = encode_int((X - 1) + (Y - 1) * 9, 1, hash);
+	float maximum = 1;
+	if constexpr(X * Y > 1) {
+		float actual = 0;
+		for(int k = 3; k < X * Y * 3; k++) actual = fmaxf(fabsf(f[k]), actual);
+		int quantised = fmaxf(0, fminf(82, floorf(actual * 166 - 0.5)));
+		maximum = ((float)quantised + 1) / 166;
+		p = encode_int(quantised, 1, p);
+	} else {
+		p = encode_int(0, 1, p);
+	}
+
+	p = encode_int((linear_to_srgb(t, f[0]) << 16) + (linear_to_srgb(t, f[1]) << 8) + linear_to_srgb(t, f[2]), 4, p);
+	for(int k = 1; k < X * Y; k++) {
+		int quant[3];
+		for(int c = 0; c < 3; c++) quant[c] = fmaxf(0, fminf(18, floorf(sign_pow(f[k * 3 + c] / maximum, 0.5) * 9 + 9.5)));
+		p = encode_int(quant[0] * 19 * 19 + quant[1] * 19 + quant[2], 2, p);
+	}
+	*p = 0;
+}
+
+// render<X, Y>: writes the image of colors[Y][X][3], a tile of columns at a time
+template<int X, int Y> void render(const tables &t, const std::array<float, 3> *colors, const image_span &image) {
+	float cos_x[X][TILE];
+	for(int x0 = 0; x0 < image.width; x0 += TILE) {
+		int n = image.width - x0 < TILE ? image.width - x0 : TILE;
+		for(int i = 0; i < X; i++) {
+			for(int k = 0; k < n; k++) cos_x[i][k] = basis(i, x0 + k, image.width);
+		}
+		for(int y = 0; y < image.height; y++) {
+			float row_colors[X][3] = {};
+			for(int j = 0; j < Y; j++) {
+				float b = basis(j, y, image.height);
+				for(int i = 0; i < X; i++) {
+					row_colors[i][0] += colors[j * X + i][0] * b;
+					row_colors[i][1] += colors[j * X + i][1] * b;
+					row_colors[i][2] += colors[j * X + i][2] * b;
+				}
+			}
+			std::uint8_t *out = image.pixels.data() + y * image.stride + (std::size_t)x0 * image.channels;
+			for(int k = 0; k < n; k++, out += image.channels) {
+				float r = 0, g = 0, b = 0;
+				for(int i = 0; i < X; i++) {
+					r += cos_x[i][k] * row_colors[i][0];
+					g += cos_x[i][k] * row_colors[i][1];
+					b += cos_x[i][k] * row_colors[i][2];
+				}
+				out[0] = linear_to_srgb(t, r);
+				out[1] = linear_to_srgb(t, g);
+				out[2] = linear_to_srgb(t, b);
+				if(image.channels == 4) out[3] = 255;
+			}
+		}
+	}
+}
+
+} // namespace detail
+
+/**
+ * @brief parses a hash into its colours.
+ * @param hash a blurhash, without NUL
+ * @param punch the factor to improve the contrast, default = 1
+ * @return the coefficients, or the error of the hash
+*/
+inline result<coefficients> parse(std::string_view hash, int punch = 1) {
+	const detail::tables &t = detail::tables::get();
+	result<coefficients> r{blurhash_error_ok, {}};
+	int size_flag = hash.empty() ? -1 : detail::decode_int(t, hash, 0, 1);
+	if(size_flag < 0 || size_flag >= 81 || hash.size() != (std::size_t)(4 + 2 * (size_flag % 9 + 1) * (size_flag / 9 + 1))) {
+		r.err = detail::invalid(blurhash_error_invalid_hash);
+		return r;
+	}
+	if(punch < 1) punch = 1;
+	r.value.x = size_flag % 9 + 1;
+	r.value.y = size_flag / 9 + 1;
+
+	int quantised_max = detail::decode_int(t, hash, 1, 2);
+	int dc = detail::decode_int(t, hash, 2, 6);
+	if(quantised_max < 0 || dc < 0) {
+		r.err = detail::invalid(quantised_max < 0 ? blurhash_error_invalid_decode_quantized_max_value : blurhash_error_invalid_decode_dc);
+		return r;
+	}
+	float maximum = ((float)(quantised_max + 1)) / 166 * punch;
+	// a DC of valid digits reaches 83^4 - 1, red saturates at 255 as in the C library
+	int red = dc >> 16 > 255 ? 255 : dc >> 16;
+	r.value.colors[0] = {t.srgb_to_linear[red], t.srgb_to_linear[(dc >> 8) & 255], t.srgb_to_linear[dc & 255]};
+	for(int k = 1; k < r.value.x * r.value.y; k++) {
+		int value = detail::decode_int(t, hash, 4 + k * 2, 6 + k * 2);
+		if(value < 0) {
+			r.err = detail::invalid(blurhash_error_invalid_decode_ac);
+			return r;
+		}
+		int quant[3] = {value / (19 * 19), value / 19 % 19, value % 19};
+		for(int c = 0; c < 3; c++) r.value.colors[k][c] = detail::sign_pow(((float)quant[c] - 9) / 9, 2.0) * maximum;
+	}
+	return r;
+}
+
+/**
+ * @brief encodes image with X x Y components.
+ * @param image the pixels
+ * @return the hash, or the error of the image
+*/
+template<int X, int Y> result<hash_t<X, Y>> encode(const image_view &image) {
+	static_assert(X >= 1 && X <= 9 && Y >= 1 && Y <= 9, "components must be in [1, 9]");
+	result<hash_t<X, Y>> r{detail::check_image(image.pixels.size(), image.width, image.height, image.stride, image.channels), {}};
+	if(r.err) return r;
+	const detail::tables &t = detail::tables::get();
+	std::array<float, X * Y * 3> f = detail::factors<X, Y>(t, image);
+	detail::quantise<X, Y>(t, f, image.width, image.height, r.value.data());
+	return r;
+}
+
+/**
+ * @brief renders coefficients of X x Y components into image.
+ * @param coeffs from `parse`, of X x Y components
+ * @param image receives the pixels
+ * @return success is `blurhash_error_ok`
+*/
+template<int X, int Y> blurhash_error_t decode(const coefficients &coeffs, const image_span &image) {
+	static_assert(X >= 1 && X <= 9 && Y >= 1 && Y <= 9, "components must be in [1, 9]");
+	if(coeffs.x != X || coeffs.y != Y) return detail::invalid(blurhash_error_invalid_hash);
+	blurhash_error_t err = detail::check_image(image.pixels.size(), image.width, image.height, image.stride, image.channels);
+	if(err) return err;
+	detail::render<X, Y>(detail::tables::get(), coeffs.colors.data(), image);
+	return blurhash_error_ok;
+}
+
+namespace detail {
+
+using encode_fn = result<any_hash_t> (*)(const image_view &);
+using decode_fn = blurhash_error_t (*)(const coefficients &, const image_span &);
+
+template<int X, int Y> result<any_hash_t> encode_any(const image_view &image) {
+	result<hash_t<X, Y>> r = encode<X, Y>(image);
+	result<any_hash_t> any{r.err, {}};
+	for(std::size_t k = 0; k < r.value.size(); k++) any.value[k] = r.value[k];
+	return any;
+}
+
+// entry K of the tables is X = K % 9 + 1, Y = K / 9 + 1, the size flag of the hash
+template<std::size_t... K> constexpr std::array<encode_fn, 81> make_encode_table(std::index_sequence<K...>) {
+	return {encode_any<K % 9 + 1, K / 9 + 1>...};
+}
+
+template<std::size_t... K> constexpr std::array<decode_fn, 81> make_decode_table(std::index_sequence<K...>) {
+	return {decode<K % 9 + 1, K / 9 + 1>...};
+}
+
+inline constexpr std::array<encode_fn, 81> encode_table = make_encode_table(std::make_index_sequence<81>{});
+inline constexpr std::array<decode_fn, 81> decode_table = make_decode_table(std::make_index_sequence<81>{});
+
+} // namespace detail
+
+/**
+ * @brief encodes image with components chosen at run time, through the instantiation for them.
+ * @param x_components range [1, 9]
+ * @param y_components range [1, 9]
+ * @param image the pixels
+ * @return the hash, or the error of the arguments
+*/
+inline result<any_hash_t> encode(int x_components, int y_components, const image_view &image) {
+	if(x_components < 1 || x_components > 9) return {detail::invalid(blurhash_error_invalid_x_components), {}};
+	if(y_components < 1 || y_components > 9) return {detail::invalid(blurhash_error_invalid_y_components), {}};
+	return detail::encode_table[(y_components - 1) * 9 + (x_components - 1)](image);
+}
+
+/**
+ * @brief decodes hash into image, through the instantiation for its components.
+ * @param hash a blurhash, without NUL
+ * @param image receives the pixels
+ * @param punch the factor to improve the contrast, default = 1
+ * @return success is `blurhash_error_ok`
+*/
+inline blurhash_error_t decode(std::string_view hash, const image_span &image, int punch = 1) {
+	result<coefficients> coeffs = parse(hash, punch);
+	if(coeffs.err) return coeffs.err;
+	return detail::decode_table[(coeffs.value.y - 1) * 9 + (coeffs.value.x - 1)](coeffs.value, image);
+}
+
+} // namespace blurhash
+
+#endif
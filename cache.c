@@ -0,0 +1,285 @@
+/* cache.c
+ * This file is part of the blurhash distribution (https://github.com/fumiama/blurhash).
+ * Copyright (c) 2018 Wolt Enterprises and Copyright (c) 2025 Fumiama Minamoto.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stddef.h>
+
+#include "blurhash.h"
+#include "common.h"
+
+// CACHE_SHARDS is the number of independently locked parts of a blurhash_cache_t, a power of 2
+#define CACHE_SHARDS 16
+
+// cacheEntry: one decoded image, allocated together with its pixels.
+// The cache holds one reference while the entry is linked in, each blurhash_cache_get caller another.
+struct cacheEntry {
+	struct cacheEntry *chain; // next entry of the same bucket
+	struct cacheEntry *newer, *older; // LRU list of the shard
+	uint64_t key;
+	int width, height, punch, nChannels;
+	size_t cost;
+	atomic_uint refs;
+	char blurhash[BLURHASH_ENCODE_BUFSZ];
+	uint8_t pixels[];
+};
+
+struct cacheShard {
+	_Alignas(64) pthread_mutex_t lock;
+	struct cacheEntry **buckets;
+	size_t nbuckets, entries, bytes;
+	struct cacheEntry *newest, *oldest;
+	uint64_t hits, misses, evictions, oversized;
+};
+
+// The budget is shared by the shards rather than split among them, so that one image may take all of it:
+// an insertion first evicts from its own shard, then, while the cache is still over budget, from the others.
+struct blurhash_cache_t {
+	size_t budget;
+	atomic_size_t bytes; // held by all shards
+	struct cacheShard shards[CACHE_SHARDS];
+};
+
+// cacheKey: FNV-1a over the hash and the decode parameters
+static uint64_t cacheKey(const char *blurhash, int width, int height, int punch, int nChannels) {
+	uint64_t key = 14695981039346656037ULL;
+	for(const char *c = blurhash; *c; c++) key = (key ^ (uint8_t)*c) * 1099511628211ULL;
+	int params[4] = {width, height, punch, nChannels};
+	for(int i = 0; i < 4; i++) key = (key ^ (uint32_t)params[i]) * 1099511628211ULL;
+	return key ^ (key >> 29);
+}
+
+static inline void releaseEntry(struct cacheEntry *entry) {
+	if(atomic_fetch_sub_explicit(&entry->refs, 1, memory_order_acq_rel) == 1) free(entry);
+}
+
+static struct cacheEntry *findEntry(struct cacheShard *shard, uint64_t key, const char *blurhash, int width, int height, int punch, int nChannels) {
+	for(struct cacheEntry *entry = shard->buckets[key & (shard->nbuckets - 1)]; entry; entry = entry->chain) {
+		if(entry->key == key && entry->width == width && entry->height == height && entry->punch == punch
+			&& entry->nChannels == nChannels && !strcmp(entry->blurhash, blurhash)) return entry;
+	}
+	return NULL;
+}
+
+static void unlinkLRU(struct cacheShard *shard, struct cacheEntry *entry) {
+	if(entry->newer) entry->newer->older = entry->older;
+	else shard->newest = entry->older;
+	if(entry->older) entry->older->newer = entry->newer;
+	else shard->oldest = entry->newer;
+}
+
+static void linkNewest(struct cacheShard *shard, struct cacheEntry *entry) {
+	entry->newer = NULL;
+	entry->older = shard->newest;
+	if(shard->newest) shard->newest->newer = entry;
+	else shard->oldest = entry;
+	shard->newest = entry;
+}
+
+// evictOldest: drops the least recently used entry of shard and the cache's reference to it
+static void evictOldest(blurhash_cache_t *cache, struct cacheShard *shard) {
+	struct cacheEntry *entry = shard->oldest;
+	struct cacheEntry **link = &shard->buckets[entry->key & (shard->nbuckets - 1)];
+	while(*link != entry) link = &(*link)->chain;
+	*link = entry->chain;
+	unlinkLRU(shard, entry);
+	shard->entries--;
+	shard->bytes -= entry->cost;
+	atomic_fetch_sub_explicit(&cache->bytes, entry->cost, memory_order_relaxed);
+	shard->evictions++;
+	releaseEntry(entry);
+}
+
+// growBuckets: doubles the buckets of shard, keeping the old ones if that fails
+static void growBuckets(struct cacheShard *shard) {
+	size_t nbuckets = shard->nbuckets * 2;
+	struct cacheEntry **buckets = calloc(nbuckets, sizeof(struct cacheEntry *));
+	if(!buckets) return;
+	for(size_t b = 0; b < shard->nbuckets; b++) {
+		struct cacheEntry *entry = shard->buckets[b];
+		while(entry) {
+			struct cacheEntry *next = entry->chain;
+			entry->chain = buckets[entry->key & (nbuckets - 1)];
+			buckets[entry->key & (nbuckets - 1)] = entry;
+			entry = next;
+		}
+	}
+	free(shard->buckets);
+	shard->buckets = buckets;
+	shard->nbuckets = nbuckets;
+}
+
+blurhash_error_t blurhash_cache_create(blurhash_cache_t **cache, size_t budget) {
+	blurhash_cache_t *c = aligned_alloc(_Alignof(blurhash_cache_t), sizeof(blurhash_cache_t));
+	if(!c) return blurhash_error_malloc;
+	memset(c, 0, sizeof(blurhash_cache_t));
+	c->budget = budget;
+	atomic_init(&c->bytes, 0);
+
+	for(int s = 0; s < CACHE_SHARDS; s++) {
+		struct cacheShard *shard = &c->shards[s];
+		shard->nbuckets = 64;
+		shard->buckets = calloc(shard->nbuckets, sizeof(struct cacheEntry *));
+		if(!shard->buckets) {
+			for(int i = 0; i < s; i++) free(c->shards[i].buckets);
+			free(c);
+			return blurhash_error_malloc;
+		}
+		pthread_mutex_init(&shard->lock, NULL);
+	}
+
+	*cache = c;
+	return blurhash_error_ok;
+}
+
+void blurhash_cache_free(blurhash_cache_t *cache) {
+	if(!cache) return;
+	for(int s = 0; s < CACHE_SHARDS; s++) {
+		struct cacheShard *shard = &cache->shards[s];
+		while(shard->oldest) evictOldest(cache, shard);
+		free(shard->buckets);
+		pthread_mutex_destroy(&shard->lock);
+	}
+	free(cache);
+}
+
+blurhash_error_t blurhash_cache_get(blurhash_cache_t *cache, const char * blurhash, int width, int height, int punch, int nChannels, const uint8_t **pixels) {
+	if(!blurhash) {
+		errno = EINVAL;
+		return blurhash_error_invalid_hash;
+	}
+	if(width <= 0 || height <= 0) {
+		errno = EINVAL;
+		return blurhash_error_invalid_rect;
+	}
+	if(nChannels != 3 && nChannels != 4) {
+		errno = EINVAL;
+		return blurhash_error_invalid_format;
+	}
+	if(punch < 1) punch = 1;
+
+	uint64_t key = cacheKey(blurhash, width, height, punch, nChannels);
+	int index = key >> 60 & (CACHE_SHARDS - 1);
+	struct cacheShard *shard = &cache->shards[index];
+	size_t size = (size_t)width * height * nChannels;
+
+	if(sizeof(struct cacheEntry) + size > cache->budget) { // never fits: decoded for the caller alone
+		pthread_mutex_lock(&shard->lock);
+		shard->oversized++;
+		pthread_mutex_unlock(&shard->lock);
+		struct cacheEntry *entry = malloc(sizeof(struct cacheEntry) + size);
+		if(!entry) return blurhash_error_malloc;
+		blurhash_error_t err = blurhash_decode(blurhash, width, height, punch, nChannels, entry->pixels);
+		if(err) {
+			free(entry);
+			return err;
+		}
+		atomic_init(&entry->refs, 1);
+		*pixels = entry->pixels;
+		return blurhash_error_ok;
+	}
+
+	pthread_mutex_lock(&shard->lock);
+	struct cacheEntry *entry = findEntry(shard, key, blurhash, width, height, punch, nChannels);
+	if(entry) {
+		atomic_fetch_add_explicit(&entry->refs, 1, memory_order_relaxed);
+		unlinkLRU(shard, entry);
+		linkNewest(shard, entry);
+		shard->hits++;
+		pthread_mutex_unlock(&shard->lock);
+		*pixels = entry->pixels;
+		return blurhash_error_ok;
+	}
+	shard->misses++;
+	pthread_mutex_unlock(&shard->lock);
+
+	// decode without holding the lock, so other keys of the shard are not blocked
+	entry = malloc(sizeof(struct cacheEntry) + size);
+	if(!entry) return blurhash_error_malloc;
+	blurhash_error_t err = blurhash_decode(blurhash, width, height, punch, nChannels, entry->pixels);
+	if(err) {
+		free(entry);
+		return err;
+	}
+	entry->key = key;
+	entry->width = width;
+	entry->height = height;
+	entry->punch = punch;
+	entry->nChannels = nChannels;
+	entry->cost = sizeof(struct cacheEntry) + size;
+	atomic_init(&entry->refs, 1);
+	strcpy(entry->blurhash, blurhash); // a valid hash fits in BLURHASH_ENCODE_BUFSZ
+
+	pthread_mutex_lock(&shard->lock);
+	struct cacheEntry *raced = findEntry(shard, key, blurhash, width, height, punch, nChannels);
+	if(raced) { // decoded by another thread meanwhile, share its copy
+		atomic_fetch_add_explicit(&raced->refs, 1, memory_order_relaxed);
+		pthread_mutex_unlock(&shard->lock);
+		free(entry);
+		*pixels = raced->pixels;
+		return blurhash_error_ok;
+	}
+	while(shard->oldest && atomic_load_explicit(&cache->bytes, memory_order_relaxed) + entry->cost > cache->budget) evictOldest(cache, shard);
+	atomic_fetch_add_explicit(&entry->refs, 1, memory_order_relaxed);
+	entry->chain = shard->buckets[key & (shard->nbuckets - 1)];
+	shard->buckets[key & (shard->nbuckets - 1)] = entry;
+	linkNewest(shard, entry);
+	shard->entries++;
+	shard->bytes += entry->cost;
+	atomic_fetch_add_explicit(&cache->bytes, entry->cost, memory_order_relaxed);
+	if(shard->entries > shard->nbuckets) growBuckets(shard);
+	pthread_mutex_unlock(&shard->lock);
+
+	// the own shard ran out of older images: take the rest from the others, one lock at a time
+	for(int s = 1; s < CACHE_SHARDS && atomic_load_explicit(&cache->bytes, memory_order_relaxed) > cache->budget; s++) {
+		struct cacheShard *other = &cache->shards[(index + s) & (CACHE_SHARDS - 1)];
+		pthread_mutex_lock(&other->lock);
+		while(other->oldest && atomic_load_explicit(&cache->bytes, memory_order_relaxed) > cache->budget) evictOldest(cache, other);
+		pthread_mutex_unlock(&other->lock);
+	}
+
+	*pixels = entry->pixels;
+	return blurhash_error_ok;
+}
+
+void blurhash_cache_release(const uint8_t *pixels) {
+	if(!pixels) return;
+	releaseEntry((struct cacheEntry *)(pixels - offsetof(struct cacheEntry, pixels)));
+}
+
+void blurhash_cache_get_stats(blurhash_cache_t *cache, blurhash_cache_stats_t *stats) {
+	memset(stats, 0, sizeof(blurhash_cache_stats_t));
+	stats->budget = cache->budget;
+	for(int s = 0; s < CACHE_SHARDS; s++) {
+		struct cacheShard *shard = &cache->shards[s];
+		pthread_mutex_lock(&shard->lock);
+		stats->hits += shard->hits;
+		stats->misses += shard->misses;
+		stats->evictions += shard->evictions;
+		stats->oversized += shard->oversized;
+		stats->entries += shard->entries;
+		stats->bytes += shard->bytes;
+		pthread_mutex_unlock(&shard->lock);
+	}
+}
@@ -0,0 +1,54 @@
+/* common.c
+ * This file is part of the blurhash distribution (https://github.com/fumiama/blurhash).
+ * Copyright (c) 2018 Wolt Enterprises and Copyright (c) 2025 Fumiama Minamoto.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "blurhash.h"
+#include "common.h"
+
+int8_t blurhash_base83_reverse_table[256];
+float blurhash_sRGBToLinear_table[256];
+uint16_t blurhash_sRGBToLinear16_table[256];
+float blurhash_sRGB16ToLinear_table[4096 + 1];
+float blurhash_linearTosRGB_table[BLURHASH_LINEAR_TABLE_SIZE + 2];
+
+// blurhash_init_tables: runs once when the library is loaded, before any encode or decode
+__attribute__((constructor)) static void blurhash_init_tables(void) {
+	memset(blurhash_base83_reverse_table, -1, sizeof(blurhash_base83_reverse_table));
+	for(int i = 0; i < 83; i++) {
+		blurhash_base83_reverse_table[(uint8_t)blurhash_base83_table[i]] = i;
+	}
+	for(int i = 0; i < 256; i++) {
+		blurhash_sRGBToLinear_table[i] = blurhash_sRGBToLinear_exact(i);
+		blurhash_sRGBToLinear16_table[i] = blurhash_sRGBToLinear_table[i] * 65535 + 0.5;
+	}
+	for(int i = 0; i <= 4096; i++) {
+		float v = (float)(i * 16) / 65535;
+		if(v <= 0.04045) blurhash_sRGB16ToLinear_table[i] = v / 12.92;
+		else blurhash_sRGB16ToLinear_table[i] = powf((v + 0.055) / 1.055, 2.4);
+	}
+	for(int i = 0; i <= BLURHASH_LINEAR_TABLE_SIZE; i++) {
+		float v = (float)i / BLURHASH_LINEAR_TABLE_SIZE;
+		if(v <= 0.0031308) blurhash_linearTosRGB_table[i] = v * 12.92 * 255;
+		else blurhash_linearTosRGB_table[i] = (1.055 * powf(v, 1 / 2.4) - 0.055) * 255;
+	}
+	blurhash_linearTosRGB_table[BLURHASH_LINEAR_TABLE_SIZE + 1] = blurhash_linearTosRGB_table[BLURHASH_LINEAR_TABLE_SIZE];
+}
@@ -24,14 +24,29 @@
  * SOFTWARE.
  */
 
+#include<errno.h>
 #include<math.h>
+#include<stddef.h>
+#include<stdatomic.h>
+#include<stdint.h>
 
 #ifndef M_PI
 #define M_PI 3.14159265358979323846
 #endif
 
+// BLURHASH_INTERNAL marks a function or table shared between the files of the library only,
+// so that it is not exported from libblurhash.so and does not become part of its ABI
+#if defined(__GNUC__)
+#define BLURHASH_INTERNAL __attribute__((visibility("hidden")))
+#else
+#define BLURHASH_INTERNAL
+#endif
+
 static char blurhash_base83_table[83]="0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz#$%*+,-.:;=?@[]^_{|}~";
 
+// blurhash_base83_reverse_table[c] is the digit of character c, or -1 if c is not in blurhash_base83_table
+BLURHASH_INTERNAL extern int8_t blurhash_base83_reverse_table[256];
+
 static inline char *blurhash_base83_encode_int(int value, int length, char *destination) {
 	int divisor = 1;
 	for(int i = 0; i < length - 1; i++) divisor *= 83;
@@ -45,33 +60,249 @@ static inline char *blurhash_base83_encode_int(int value, int length, char *dest
 }
 
 static inline int blurhash_base83_decode_int(const char * string, int start, int end) {
-	int value = 0, iter1 = 0, iter2 = 0;
+	int value = 0, iter1 = 0;
 	for( iter1 = start; iter1 < end; iter1 ++) {
-		int index = -1;
-		for(iter2 = 0; iter2 < 83; iter2 ++) {
-			if (blurhash_base83_table[iter2] == string[iter1]) {
-				index = iter2;
-				break;
-			}
-		}
+		int index = blurhash_base83_reverse_table[(uint8_t)string[iter1]];
 		if (index == -1) return -1;
 		value = value * 83 + index;
 	}
 	return value;
 }
 
-static inline int blurhash_linearTosRGB(float value) {
+static inline int blurhash_linearTosRGB_exact(float value) {
 	float v = fmaxf(0, fminf(1, value));
 	if(v <= 0.0031308) return v * 12.92 * 255 + 0.5;
 	else return (1.055 * powf(v, 1 / 2.4) - 0.055) * 255 + 0.5;
 }
 
-static inline float blurhash_sRGBToLinear(int value) {
+static inline float blurhash_sRGBToLinear_exact(int value) {
 	float v = (float)value / 255;
 	if(v <= 0.04045) return v / 12.92;
 	else return powf((v + 0.055) / 1.055, 2.4);
 }
 
+// BLURHASH_LINEAR_TABLE_SIZE is the number of intervals [0, 1] is split into by blurhash_linearTosRGB_table
+#define BLURHASH_LINEAR_TABLE_SIZE 4096
+
+// blurhash_sRGBToLinear_table[v] == blurhash_sRGBToLinear_exact(v), filled in common.c at load time
+BLURHASH_INTERNAL extern float blurhash_sRGBToLinear_table[256];
+// blurhash_sRGBToLinear16_table[v] is blurhash_sRGBToLinear_exact(v) in 0.16 fixed point
+BLURHASH_INTERNAL extern uint16_t blurhash_sRGBToLinear16_table[256];
+// blurhash_sRGB16ToLinear_table[i] is the linear value of 16-bit sRGB i * 16, with one extra trailing entry
+BLURHASH_INTERNAL extern float blurhash_sRGB16ToLinear_table[4096 + 1];
+// blurhash_linearTosRGB_table[i] is the unrounded sRGB value (0 ~ 255) of linear i / BLURHASH_LINEAR_TABLE_SIZE,
+// with one extra trailing entry so that interpolating at exactly 1 stays in bounds
+BLURHASH_INTERNAL extern float blurhash_linearTosRGB_table[BLURHASH_LINEAR_TABLE_SIZE + 2];
+
+// BLURHASH_Q15_ONE is linear 1.0 in the Q15 fixed point of blurhash_decode_fixed
+#define BLURHASH_Q15_ONE (1 << 15)
+// blurhash_linearQ15TosRGB_table[v] is the rounded sRGB value of linear v / BLURHASH_Q15_ONE, filled in fixed.c at load time
+BLURHASH_INTERNAL extern uint8_t blurhash_linearQ15TosRGB_table[BLURHASH_Q15_ONE + 1];
+
+// blurhash_linearTosRGB_unrounded: the sRGB value (0 ~ 255) of linear value before rounding, from the table
+static inline float blurhash_linearTosRGB_unrounded(float value) {
+	float v = fmaxf(0, fminf(1, value)) * BLURHASH_LINEAR_TABLE_SIZE;
+	int i = (int)v;
+	float lo = blurhash_linearTosRGB_table[i], hi = blurhash_linearTosRGB_table[i + 1];
+	return lo + (v - i) * (hi - lo);
+}
+
+#ifdef BLURHASH_EXACT_SRGB
+
+#define blurhash_linearTosRGB blurhash_linearTosRGB_exact
+#define blurhash_sRGBToLinear blurhash_sRGBToLinear_exact
+
+#else
+
+// blurhash_linearTosRGB: table-driven blurhash_linearTosRGB_exact.
+// Linear interpolation between the 4097 samples is off by less than 0.005 of an 8-bit step,
+// so the result is never more than 1 away from the exact one, and only differs when
+// the exact value lies within 0.005 of a rounding boundary (about 2 in 100000 inputs).
+static inline int blurhash_linearTosRGB(float value) {
+	return blurhash_linearTosRGB_unrounded(value) + 0.5;
+}
+
+// blurhash_sRGBToLinear: table-driven blurhash_sRGBToLinear_exact, bit-identical to it for value in [0, 255];
+// callers clamp larger values, such as the red of a DC above 0xFFFFFF, rather than let them wrap here
+static inline float blurhash_sRGBToLinear(int value) {
+	return blurhash_sRGBToLinear_table[value & 255];
+}
+
+#endif
+
+static inline blurhash_error_t blurhash_checkComponents(int xComponents, int yComponents) {
+	if(xComponents < 1 || xComponents > 9) {
+		errno = EINVAL;
+		return blurhash_error_invalid_x_components;
+	}
+	if(yComponents < 1 || yComponents > 9) {
+		errno = EINVAL;
+		return blurhash_error_invalid_y_components;
+	}
+	return blurhash_error_ok;
+}
+
+// blurhash_fillBasisRange: table[i * count + p] = cos(pi * i * (first + p) / n) for i in [0, components)
+static inline void blurhash_fillBasisRange(int components, int n, int first, int count, float *table) {
+	for(int i = 0; i < components; i++) {
+		for(int p = 0; p < count; p++) {
+			table[i * count + p] = cosf(M_PI * i * (first + p) / n);
+		}
+	}
+}
+
+// blurhash_fillBasisTable: table[i * n + p] = cos(pi * i * p / n) for i in [0, components)
+static inline void blurhash_fillBasisTable(int components, int n, float *table) {
+	blurhash_fillBasisRange(components, n, 0, n, table);
+}
+
+// blurhash_scratch_t: a growable float buffer that one thread reuses across calls
+typedef struct {
+	float *data;
+	size_t size;
+} blurhash_scratch_t;
+
+// blurhash_scratch_reserve: grows scratch to at least count floats, NULL if out of memory
+BLURHASH_INTERNAL float *blurhash_scratch_reserve(blurhash_scratch_t *scratch, size_t count);
+
+// blurhash_ctx_t: a scratch buffer and the basis tables of recently seen image sides, see ctx.c
+struct blurhash_ctx_t {
+	blurhash_scratch_t scratch;
+	float factors[9 * 9 * 3];
+	uint64_t clock; // incremented by every table lookup, for LRU
+	struct {
+		int n; // side length, 0 if unused
+		int components; // rows of table filled
+		int capacity; // longest side table has room for, >= n
+		uint64_t used; // clock of the last lookup
+		float *table; // room for 9 rows of capacity, holding 9 rows of n
+	} tables[BLURHASH_CTX_TABLES];
+};
+
+// blurhash_ctx_basis: blurhash_fillBasisTable(components, n) from the tables of ctx, NULL if out of memory.
+// A later lookup may evict or move it, except for a different n in the same call: two sides never evict each other.
+BLURHASH_INTERNAL const float *blurhash_ctx_basis(blurhash_ctx_t *ctx, int n, int components);
+
+// blurhash_encode_scratch: blurhash_encode_ex taking its tables and row buffers from scratch
+BLURHASH_INTERNAL blurhash_error_t blurhash_encode_scratch(int xComponents, int yComponents, int width, int height, blurhash_format_t format,
+	const void *pixels, size_t bytesPerRow, char* buffer, blurhash_scratch_t *scratch);
+
+// blurhash_render_rows: renders rows [0, rows) of colors[numY][numX][3] into buffer, row r using cosY[j * cosYStride + r]
+// and cosX[i * width + x]; linear is 3 * width floats of scratch
+BLURHASH_INTERNAL void blurhash_render_rows(int numX, int numY, const float *colors, int width, int rows, const float *cosX,
+	const float *cosY, int cosYStride, int nChannels, size_t bytesPerRow, float *linear, uint8_t *buffer);
+
+// blurhash_load_file: loads filename as 8-bit RGB like stbi_load, decoding straight from a read-only
+// mapping of the file when it is a regular file, NULL on failure; free the result with stbi_image_free
+BLURHASH_INTERNAL unsigned char *blurhash_load_file(const char *filename, int *width, int *height);
+
+// stats: every public encode or decode entry point wraps its work in
+//	uint64_t start = blurhash_stats_begin(op);
+//	...
+//	return blurhash_stats_end(start, pixels, bytes, err);
+// and times its stages by blurhash_stats_stage(stage, blurhash_stats_clock()) pairs.
+// A start of 0 means the stats were off when the call began, and nothing is recorded.
+#ifdef BLURHASH_NO_STATS
+
+static inline uint64_t blurhash_stats_begin(blurhash_stats_op_t op) { (void)op; return 0; }
+static inline uint64_t blurhash_stats_clock(void) { return 0; }
+static inline void blurhash_stats_stage(blurhash_stats_stage_t stage, uint64_t start) { (void)stage; (void)start; }
+static inline void blurhash_stats_add(blurhash_stats_stage_t stage, uint64_t ns) { (void)stage; (void)ns; }
+static inline uint64_t blurhash_stats_since(uint64_t start) { (void)start; return 0; }
+static inline blurhash_error_t blurhash_stats_end(uint64_t start, uint64_t pixels, uint64_t bytes, blurhash_error_t err) {
+	(void)start; (void)pixels; (void)bytes;
+	return err;
+}
+
+#else
+
+BLURHASH_INTERNAL extern atomic_bool blurhash_stats_enabled;
+// blurhash_stats_now: monotonic ns, never 0
+BLURHASH_INTERNAL uint64_t blurhash_stats_now(void);
+BLURHASH_INTERNAL uint64_t blurhash_stats_enter(blurhash_stats_op_t op);
+BLURHASH_INTERNAL void blurhash_stats_leave(uint64_t start, uint64_t pixels, uint64_t bytes, blurhash_error_t err);
+// blurhash_stats_add: adds ns to stage of the call in progress on this thread
+BLURHASH_INTERNAL void blurhash_stats_add(blurhash_stats_stage_t stage, uint64_t ns);
+
+static inline bool blurhash_stats_on(void) {
+	return __builtin_expect(atomic_load_explicit(&blurhash_stats_enabled, memory_order_relaxed), 0);
+}
+
+static inline uint64_t blurhash_stats_begin(blurhash_stats_op_t op) {
+	return blurhash_stats_on() ? blurhash_stats_enter(op) : 0;
+}
+
+static inline uint64_t blurhash_stats_clock(void) {
+	return blurhash_stats_on() ? blurhash_stats_now() : 0;
+}
+
+// blurhash_stats_since: ns from start of blurhash_stats_clock, 0 if the stats were off then
+static inline uint64_t blurhash_stats_since(uint64_t start) {
+	return start ? blurhash_stats_now() - start : 0;
+}
+
+static inline void blurhash_stats_stage(blurhash_stats_stage_t stage, uint64_t start) {
+	if(start) blurhash_stats_add(stage, blurhash_stats_now() - start);
+}
+
+static inline blurhash_error_t blurhash_stats_end(uint64_t start, uint64_t pixels, uint64_t bytes, blurhash_error_t err) {
+	if(start) blurhash_stats_leave(start, pixels, bytes, err);
+	return err;
+}
+
+#endif
+
+// BLURHASH_DISPATCH builds an SSE2 (default), AVX2 and AVX-512 copy of a kernel;
+// the best one for the running CPU is picked once by cpuid when the library is loaded.
+// Define BLURHASH_NO_DISPATCH to build the plain version only.
+#if defined(__GNUC__) && defined(__x86_64__) && defined(__ELF__) && !defined(BLURHASH_NO_DISPATCH)
+#define BLURHASH_DISPATCH __attribute__((target_clones("avx512f", "avx2", "default")))
+#else
+#define BLURHASH_DISPATCH
+#endif
+
+// blurhash_kernel_linearise_row: converts width pixels of format into planar linear r, g, b
+BLURHASH_INTERNAL void blurhash_kernel_linearise_row(const uint8_t *row, blurhash_format_t format, int width, float *r, float *g, float *b);
+
+// blurhash_kernel_row_sums: sums[i][c] = sum over x of basis[i * width + x] * {r, g, b}[x] for i in [0, components)
+BLURHASH_INTERNAL void blurhash_kernel_row_sums(const float *basis, int components, int width, const float *r, const float *g, const float *b, float *sums);
+
+// blurhash_kernel_add_basis: {r, g, b}[x] += {cr, cg, cb} * basis[x] for x in [0, width)
+BLURHASH_INTERNAL void blurhash_kernel_add_basis(const float *basis, float cr, float cg, float cb, int width, float *r, float *g, float *b);
+
+// blurhash_kernel_resample_row: linear interpolation of samples src[0, samples] onto dst,
+// pixels [runStart[k], runStart[k + 1]) lying between src[k] and src[k + 1] at weight[x]
+BLURHASH_INTERNAL void blurhash_kernel_resample_row(const float *src, const int *runStart, int samples, const float *weight, float *dst);
+
+// blurhash_kernel_pack_row: writes planar r, g, b (0 ~ 255) as width rounded pixels of nChannels (3 or 4, alpha = 255)
+BLURHASH_INTERNAL void blurhash_kernel_pack_row(const float *r, const float *g, const float *b, int width, int nChannels, uint8_t *out);
+
+// blurhash_kernel_add_basis_fixed: {r, g, b}[x] += {cr, cg, cb} * basis[x] / 2^12 rounded, for x in [0, width),
+// on Q15 colours within +-2^17 and a Q14 basis, into Q17 sums
+BLURHASH_INTERNAL void blurhash_kernel_add_basis_fixed(const int32_t *basis, int32_t cr, int32_t cg, int32_t cb, int width, int32_t *r, int32_t *g, int32_t *b);
+
+// blurhash_kernel_store_row_fixed: writes planar Q17 linear r, g, b as width sRGB pixels of nChannels (3 or 4, alpha = 255)
+BLURHASH_INTERNAL void blurhash_kernel_store_row_fixed(const int32_t *r, const int32_t *g, const int32_t *b, int width, int nChannels, uint8_t *out);
+
+// blurhash_kernel_base83_check: whether all length (>= 16) characters of s are in blurhash_base83_table,
+// by range compares on 16 characters at a time instead of table lookups
+BLURHASH_INTERNAL bool blurhash_kernel_base83_check(const char *s, int length);
+
+// blurhash_kernel_store_row: writes planar linear r, g, b as width sRGB pixels of nChannels (3 or 4, alpha = 255)
+BLURHASH_INTERNAL void blurhash_kernel_store_row(const float *r, const float *g, const float *b, int width, int nChannels, uint8_t *out);
+
+// blurhash_kernel_feature_distances: out[k] = squared Euclidean distance of query and the BLURHASH_FEATURE_DIMS
+// features at vectors + k * stride, for k in [0, n)
+BLURHASH_INTERNAL void blurhash_kernel_feature_distances(const int8_t *query, const uint8_t *vectors, size_t stride, int n, uint32_t *out);
+
+// blurhash_sRGB16ToLinear: 16-bit sRGB to linear, interpolated between the samples of
+// blurhash_sRGB16ToLinear_table, less than 1e-7 away from the exact value
+static inline float blurhash_sRGB16ToLinear(uint16_t value) {
+	int i = value >> 4;
+	float lo = blurhash_sRGB16ToLinear_table[i], hi = blurhash_sRGB16ToLinear_table[i + 1];
+	return lo + (value & 15) * (hi - lo) * (1.0f / 16);
+}
+
 static inline float blurhash_signPow(float value, float exp) {
 	return copysignf(powf(fabsf(value), exp), value);
 }
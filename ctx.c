@@ -0,0 +1,77 @@
+/* ctx.c
+ * This file is part of the blurhash distribution (https://github.com/fumiama/blurhash).
+ * Copyright (c) 2018 Wolt Enterprises and Copyright (c) 2025 Fumiama Minamoto.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "blurhash.h"
+#include "common.h"
+
+blurhash_error_t blurhash_ctx_create(blurhash_ctx_t **ctx) {
+	blurhash_ctx_t *c = calloc(1, sizeof(blurhash_ctx_t));
+	if(!c) return blurhash_error_malloc;
+	*ctx = c;
+	return blurhash_error_ok;
+}
+
+void blurhash_ctx_free(blurhash_ctx_t *ctx) {
+	if(!ctx) return;
+	for(int i = 0; i < BLURHASH_CTX_TABLES; i++) free(ctx->tables[i].table);
+	free(ctx->scratch.data);
+	free(ctx);
+}
+
+// Each table has room for all 9 rows of its side but only the rows asked for are filled, so a miss costs no more
+// cosf than the context-free calls, and a side used with more components later only fills the missing rows.
+// Tables never move once allocated for a side, so the pointer of one side stays valid while the other is looked up.
+const float *blurhash_ctx_basis(blurhash_ctx_t *ctx, int n, int components) {
+	int slot = 0;
+	ctx->clock++;
+	for(int i = 0; i < BLURHASH_CTX_TABLES; i++) {
+		if(ctx->tables[i].n == n && ctx->tables[i].table) {
+			slot = i;
+			goto found;
+		}
+		if(ctx->tables[i].used < ctx->tables[slot].used) slot = i;
+	}
+
+	// the least recently used slot is taken over, keeping its memory if it is large enough
+	if(ctx->tables[slot].capacity < n) {
+		// the old rows are of another side, so they are not copied
+		free(ctx->tables[slot].table);
+		ctx->tables[slot].table = malloc(sizeof(float) * 9 * n);
+		ctx->tables[slot].capacity = ctx->tables[slot].table ? n : 0;
+		if(!ctx->tables[slot].table) {
+			ctx->tables[slot].n = 0;
+			return NULL;
+		}
+	}
+	ctx->tables[slot].n = n;
+	ctx->tables[slot].components = 0;
+
+found:
+	ctx->tables[slot].used = ctx->clock;
+	float *table = ctx->tables[slot].table;
+	for(int i = ctx->tables[slot].components; i < components; i++) {
+		for(int p = 0; p < n; p++) table[i * n + p] = cosf(M_PI * i * p / n);
+	}
+	if(components > ctx->tables[slot].components) ctx->tables[slot].components = components;
+	return table;
+}
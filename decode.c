@@ -22,33 +22,53 @@
  */
 
 #include <errno.h>
+#include <pthread.h>
 #include <stb/stb_image_write.h>
+#include <unistd.h>
 
 #include "blurhash.h"
 #include "common.h"
 
-static inline uint8_t blurhash_clampToUByte(int s) {
-	if (s < 0) return 0;
-	if (s>>8) return 255;
-	return (uint8_t)s;
+// hashLength: the length of a blurhash starting with sizeChar, or -1 if sizeChar is not a valid size flag
+static inline int hashLength(char sizeChar) {
+	int sizeFlag = blurhash_base83_reverse_table[(uint8_t)sizeChar];
+	if (sizeFlag < 0 || sizeFlag >= 9 * 9) return -1;
+	int numY = sizeFlag / 9 + 1;
+	int numX = sizeFlag % 9 + 1;
+	return 4 + 2 * numX * numY;
 }
 
 bool blurhash_is_valid(const char * blurhash) {
+	if ( !blurhash ) return false;
 
-	const int hashLength = strlen(blurhash);
+	int hashLen = hashLength(blurhash[0]);
+	if (hashLen < 0) return false;
 
-	if ( !blurhash || strlen(blurhash) < 6) return false;
-
-	int sizeFlag = blurhash_base83_decode_int(blurhash, 0, 1);	//Get size from first character
-	int numY = (int)floorf(sizeFlag / 9) + 1;
-	int numX = (sizeFlag % 9) + 1;
+	// a terminating '\0' before hashLen is not in the alphabet either, so this never reads past it
+	for(int i = 1; i < hashLen; i ++) {
+		if (blurhash_base83_reverse_table[(uint8_t)blurhash[i]] < 0) return false;
+	}
+	return blurhash[hashLen] == '\0';
+}
 
-	if (hashLength != 4 + 2 * numX * numY) return false;
-	return true;
+size_t blurhash_validate_batch(const char ** hashes, size_t n, uint8_t * results) {
+	size_t valid = 0;
+	for(size_t i = 0; i < n; i ++) {
+		const char *blurhash = hashes[i];
+		int hashLen = blurhash ? hashLength(blurhash[0]) : -1;
+		// the length is checked first, so the vector check never reads past the end of the string
+		if (hashLen < 0 || strnlen(blurhash, hashLen + 1) != (size_t)hashLen) results[i] = 0;
+		else if (hashLen < 16) results[i] = blurhash_is_valid(blurhash);
+		else results[i] = blurhash_kernel_base83_check(blurhash, hashLen);
+		valid += results[i];
+	}
+	return valid;
 }
 
+// decodeDC: a DC of valid digits reaches 83^4 - 1, so red saturates at 255 as the exact conversion does
 static void decodeDC(int value, float * r, float * g, float * b) {
-	*r = blurhash_sRGBToLinear(value >> 16); 	// R-component
+	int red = value >> 16;
+	*r = blurhash_sRGBToLinear(red > 255 ? 255 : red); 	// R-component
 	*g = blurhash_sRGBToLinear((value >> 8) & 255); // G-Component
 	*b = blurhash_sRGBToLinear(value & 255);	// B-Component
 }
@@ -63,7 +83,39 @@ static void decodeAC(int value, float maximumValue, float * r, float * g, float
 	*b = blurhash_signPow(((float)quantB - 9) / 9, 2.0) * maximumValue;
 }
 
-blurhash_error_t blurhash_decode(const char * blurhash, int width, int height, int punch, int nChannels, uint8_t* buffer) {
+// blurhash_render_rows: renders rows [0, rows) of the image described by colors[numY][numX][3] into buffer,
+// row r using cosY[j * cosYStride + r]. The numY terms of each row are first collapsed into numX
+// per-row colours, so every pixel only sums numX terms, i.e. pixels * numX + rows * numX * numY work
+// instead of pixels * numX * numY.
+void blurhash_render_rows(int numX, int numY, const float *colors, int width, int rows, const float *cosX,
+	const float *cosY, int cosYStride, int nChannels, size_t bytesPerRow, float *linear, uint8_t *buffer) {
+	float *lr = linear, *lg = linear + width, *lb = linear + 2 * width;
+
+	for(int y = 0; y < rows; y ++) {
+		float rowColors[numX][3];
+		memset(rowColors, 0, sizeof(rowColors));
+
+		for(int j = 0; j < numY; j ++) {
+			float basis = cosY[j * cosYStride + y];
+			const float *color = colors + j * numX * 3;
+			for(int i = 0; i < numX; i ++) {
+				rowColors[i][0] += color[i * 3 + 0] * basis;
+				rowColors[i][1] += color[i * 3 + 1] * basis;
+				rowColors[i][2] += color[i * 3 + 2] * basis;
+			}
+		}
+
+		memset(lr, 0, sizeof(float) * 3 * width);
+		for(int i = 0; i < numX; i ++) {
+			blurhash_kernel_add_basis(cosX + i * width, rowColors[i][0], rowColors[i][1], rowColors[i][2], width, lr, lg, lb);
+		}
+
+		blurhash_kernel_store_row(lr, lg, lb, width, nChannels, buffer + y * bytesPerRow);
+	}
+}
+
+blurhash_error_t blurhash_parse(const char * blurhash, int punch, blurhash_coeffs_t *coeffs) {
+	uint64_t start = blurhash_stats_clock();
 	if (! blurhash_is_valid(blurhash)) {
 		errno = EINVAL;
 		return blurhash_error_invalid_hash;
@@ -75,7 +127,6 @@ blurhash_error_t blurhash_decode(const char * blurhash, int width, int height, i
 	int numX = (sizeFlag % 9) + 1;
 	int iter = 0;
 
-	float r = 0, g = 0, b = 0;
 	int quantizedMaxValue = blurhash_base83_decode_int(blurhash, 1, 2);
 	if (quantizedMaxValue == -1) {
 		errno = EINVAL;
@@ -85,7 +136,7 @@ blurhash_error_t blurhash_decode(const char * blurhash, int width, int height, i
 	float maxValue = ((float)(quantizedMaxValue + 1)) / 166;
 
 	int colors_size = numX * numY;
-	float colors[colors_size][3];
+	float (*colors)[3] = coeffs->colors;
 
 	for(iter = 0; iter < colors_size; iter ++) {
 		if (iter == 0) {
@@ -94,62 +145,269 @@ blurhash_error_t blurhash_decode(const char * blurhash, int width, int height, i
 				errno = EINVAL;
 				return blurhash_error_invalid_decode_dc;
 			}
-			decodeDC(value, &r, &g, &b);
-			colors[iter][0] = r;
-			colors[iter][1] = g;
-			colors[iter][2] = b;
-
+			decodeDC(value, &colors[iter][0], &colors[iter][1], &colors[iter][2]);
 		} else {
 			int value = blurhash_base83_decode_int(blurhash, 4 + iter * 2, 6 + iter * 2);
 			if (value == -1) {
 				errno = EINVAL;
 				return blurhash_error_invalid_decode_ac;
 			}
-			decodeAC(value, maxValue * punch, &r, &g, &b);
-			colors[iter][0] = r;
-			colors[iter][1] = g;
-			colors[iter][2] = b;
+			decodeAC(value, maxValue * punch, &colors[iter][0], &colors[iter][1], &colors[iter][2]);
 		}
 	}
 
-	int bytesPerRow = width * nChannels;
-	int x = 0, y = 0, i = 0, j = 0;
-	int intR = 0, intG = 0, intB = 0;
+	coeffs->numX = numX;
+	coeffs->numY = numY;
 
-	for(y = 0; y < height; y ++) {
-		for(x = 0; x < width; x ++) {
+	blurhash_stats_stage(blurhash_stats_stage_parse, start);
 
-			float r = 0, g = 0, b = 0;
+	return blurhash_error_ok;
+}
 
-			for(j = 0; j < numY; j ++) {
-				for(i = 0; i < numX; i ++) {
-					float basics = cos((M_PI * x * i) / width) * cos((M_PI * y * j) / height);
-					int idx = i + j * numX;
-					r += colors[idx][0] * basics;
-					g += colors[idx][1] * basics;
-					b += colors[idx][2] * basics;
-				}
-			}
+blurhash_error_t blurhash_render_rect(const blurhash_coeffs_t *coeffs, int fullWidth, int fullHeight, int x0, int y0, int width, int height, int nChannels, size_t bytesPerRow, uint8_t* buffer) {
+	uint64_t start = blurhash_stats_begin(blurhash_stats_op_decode);
+	if (x0 < 0 || y0 < 0 || width < 0 || height < 0 || width > fullWidth - x0 || height > fullHeight - y0) {
+		errno = EINVAL;
+		return blurhash_stats_end(start, 0, 0, blurhash_error_invalid_rect);
+	}
+	if (!width || !height) return blurhash_stats_end(start, 0, 0, blurhash_error_ok);
+
+	int numX = coeffs->numX, numY = coeffs->numY;
+
+	float *scratch = malloc(sizeof(float) * (numX * width + numY * height + 3 * width));
+	if (!scratch) return blurhash_stats_end(start, 0, 0, blurhash_error_malloc);
+	float *cosX = scratch, *cosY = cosX + numX * width, *linear = cosY + numY * height;
+	blurhash_fillBasisRange(numX, fullWidth, x0, width, cosX);
+	blurhash_fillBasisRange(numY, fullHeight, y0, height, cosY);
+
+	uint64_t render = blurhash_stats_clock();
+	blurhash_render_rows(numX, numY, coeffs->colors[0], width, height, cosX, cosY, height, nChannels, bytesPerRow, linear, buffer);
+	blurhash_stats_stage(blurhash_stats_stage_render, render);
+
+	free(scratch);
+
+	return blurhash_stats_end(start, (uint64_t)width * height, (uint64_t)width * height * nChannels, blurhash_error_ok);
+}
+
+blurhash_error_t blurhash_decode(const char * blurhash, int width, int height, int punch, int nChannels, uint8_t* buffer) {
+	uint64_t start = blurhash_stats_begin(blurhash_stats_op_decode);
+	blurhash_coeffs_t coeffs;
+	blurhash_error_t err = blurhash_parse(blurhash, punch, &coeffs);
+	if (err) return blurhash_stats_end(start, 0, 0, err);
+
+	err = blurhash_render_rect(&coeffs, width, height, 0, 0, width, height, nChannels, (size_t)width * nChannels, buffer);
+	return blurhash_stats_end(start, (uint64_t)width * height, (uint64_t)width * height * nChannels, err);
+}
+
+blurhash_error_t blurhash_decode_ctx(blurhash_ctx_t *ctx, const char * blurhash, int width, int height, int punch, int nChannels, uint8_t* buffer) {
+	uint64_t start = blurhash_stats_begin(blurhash_stats_op_decode);
+	blurhash_coeffs_t coeffs;
+	blurhash_error_t err = blurhash_parse(blurhash, punch, &coeffs);
+	if (err) return blurhash_stats_end(start, 0, 0, err);
+	if (width <= 0 || height <= 0) {
+		errno = EINVAL;
+		return blurhash_stats_end(start, 0, 0, blurhash_error_invalid_rect);
+	}
+
+	const float *cosX = blurhash_ctx_basis(ctx, width, coeffs.numX);
+	const float *cosY = cosX ? blurhash_ctx_basis(ctx, height, coeffs.numY) : NULL;
+	float *linear = blurhash_scratch_reserve(&ctx->scratch, 3 * width);
+	if (!cosY || !linear) return blurhash_stats_end(start, 0, 0, blurhash_error_malloc);
+
+	uint64_t render = blurhash_stats_clock();
+	blurhash_render_rows(coeffs.numX, coeffs.numY, coeffs.colors[0], width, height, cosX, cosY, height, nChannels, (size_t)width * nChannels, linear, buffer);
+	blurhash_stats_stage(blurhash_stats_stage_render, render);
+
+	return blurhash_stats_end(start, (uint64_t)width * height, (uint64_t)width * height * nChannels, blurhash_error_ok);
+}
+
+// decodeBand: one horizontal band of blurhash_decode_mt
+struct decodeBand {
+	const blurhash_coeffs_t *coeffs;
+	int width, height, nChannels;
+	int y0, y1;
+	const float *cosX, *cosY;
+	float *linear;
+	uint8_t *buffer;
+};
+
+static void *decodeBandThread(void *arg) {
+	struct decodeBand *band = (struct decodeBand *)arg;
+	size_t bytesPerRow = (size_t)band->width * band->nChannels;
+	blurhash_render_rows(band->coeffs->numX, band->coeffs->numY, band->coeffs->colors[0], band->width, band->y1 - band->y0,
+		band->cosX, band->cosY + band->y0, band->height, band->nChannels, bytesPerRow, band->linear, band->buffer + band->y0 * bytesPerRow);
+	return NULL;
+}
+
+blurhash_error_t blurhash_decode_mt(const char * blurhash, int width, int height, int punch, int nChannels, uint8_t* buffer, int nthreads) {
+	if (nthreads <= 0) nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+	if (nthreads > height) nthreads = height;
+	if (nthreads <= 1) return blurhash_decode(blurhash, width, height, punch, nChannels, buffer);
+
+	uint64_t start = blurhash_stats_begin(blurhash_stats_op_decode);
+	blurhash_coeffs_t coeffs;
+	blurhash_error_t err = blurhash_parse(blurhash, punch, &coeffs);
+	if (err) return blurhash_stats_end(start, 0, 0, err);
+
+	int numX = coeffs.numX, numY = coeffs.numY;
+
+	float *scratch = malloc(sizeof(float) * (numX * width + numY * height + (size_t)nthreads * 3 * width));
+	struct decodeBand *bands = malloc(sizeof(struct decodeBand) * nthreads);
+	pthread_t *threads = malloc(sizeof(pthread_t) * nthreads);
+	bool *started = calloc(nthreads, sizeof(bool));
+	if (!scratch || !bands || !threads || !started) {
+		free(scratch); free(bands); free(threads); free(started);
+		return blurhash_stats_end(start, 0, 0, blurhash_error_malloc);
+	}
+
+	float *cosX = scratch, *cosY = cosX + numX * width, *ptr = cosY + numY * height;
+	blurhash_fillBasisTable(numX, width, cosX);
+	blurhash_fillBasisTable(numY, height, cosY);
 
-			buffer[nChannels * x + 0 + y * bytesPerRow] = blurhash_clampToUByte(blurhash_linearTosRGB(r));
-			buffer[nChannels * x + 1 + y * bytesPerRow] = blurhash_clampToUByte(blurhash_linearTosRGB(g));
-			buffer[nChannels * x + 2 + y * bytesPerRow] = blurhash_clampToUByte(blurhash_linearTosRGB(b));
+	for(int t = 0; t < nthreads; t ++) {
+		struct decodeBand *band = &bands[t];
+		band->coeffs = &coeffs;
+		band->width = width;
+		band->height = height;
+		band->nChannels = nChannels;
+		band->y0 = (int)((int64_t)height * t / nthreads);
+		band->y1 = (int)((int64_t)height * (t + 1) / nthreads);
+		band->cosX = cosX;
+		band->cosY = cosY;
+		band->linear = ptr;
+		band->buffer = buffer;
+		ptr += 3 * width;
+	}
+
+	// band 0 runs on the calling thread, as does any band whose thread could not be created
+	uint64_t render = blurhash_stats_clock();
+	for(int t = 1; t < nthreads; t ++) {
+		started[t] = pthread_create(&threads[t], NULL, decodeBandThread, &bands[t]) == 0;
+	}
+	for(int t = 0; t < nthreads; t ++) {
+		if (!started[t]) decodeBandThread(&bands[t]);
+	}
+	for(int t = 1; t < nthreads; t ++) {
+		if (started[t]) pthread_join(threads[t], NULL);
+	}
+	blurhash_stats_stage(blurhash_stats_stage_render, render);
 
-			if (nChannels == 4)
-				buffer[nChannels * x + 3 + y * bytesPerRow] = 255;   // If nChannels=4, treat each pixel as RGBA instead of RGB
+	free(scratch); free(bands); free(threads); free(started);
 
+	return blurhash_stats_end(start, (uint64_t)width * height, (uint64_t)width * height * nChannels, blurhash_error_ok);
+}
+
+// fillSamplePositions: spreads samples points evenly over pixels [0, n - 1], giving table[i * samples + k]
+// the basis of component i at point k. Pixels [runStart[k], runStart[k + 1]) lie between point k and k + 1,
+// pixel p at weight[p] towards k + 1; the caller keeps one duplicate point after the last one
+static void fillSamplePositions(int components, int n, int samples, float *table, int *runStart, float *weight) {
+	float step = samples > 1 ? (float)(n - 1) / (samples - 1) : 0;
+	for(int i = 0; i < components; i++) {
+		for(int k = 0; k < samples; k++) {
+			table[i * samples + k] = cosf(M_PI * i * (k * step) / n);
 		}
 	}
+	for(int k = 0; k <= samples; k++) runStart[k] = n;
+	for(int p = n - 1; p >= 0; p--) {
+		float position = samples > 1 ? (float)p * (samples - 1) / (n - 1) : 0;
+		int k = (int)position;
+		if (k > samples - 1) k = samples - 1;
+		runStart[k] = p;
+		weight[p] = position - k;
+	}
+	for(int k = samples - 1; k >= 0; k--) {
+		if (runStart[k] > runStart[k + 1]) runStart[k] = runStart[k + 1];
+	}
+}
 
-	return blurhash_error_ok;
+// fastSamples: grid points along an axis of n pixels with the given number of components
+static inline int fastSamples(int n, int components) {
+	int samples = BLURHASH_FAST_DECODE_SAMPLES * components;
+	if (samples < 2) samples = 2;
+	return samples < n ? samples : n;
+}
+
+blurhash_error_t blurhash_decode_fast(const char * blurhash, int width, int height, int punch, int nChannels, uint8_t* buffer) {
+	uint64_t start = blurhash_stats_begin(blurhash_stats_op_decode);
+	uint64_t pixels = (uint64_t)width * height;
+	blurhash_coeffs_t coeffs;
+	blurhash_error_t err = blurhash_parse(blurhash, punch, &coeffs);
+	if (err) return blurhash_stats_end(start, 0, 0, err);
+
+	int numX = coeffs.numX, numY = coeffs.numY;
+	int gridWidth = fastSamples(width, numX), gridHeight = fastSamples(height, numY);
+	if (gridWidth == width && gridHeight == height) {
+		err = blurhash_render_rect(&coeffs, width, height, 0, 0, width, height, nChannels, (size_t)width * nChannels, buffer);
+		return blurhash_stats_end(start, pixels, pixels * nChannels, err);
+	}
+
+	size_t gridRow = gridWidth + 1; // one duplicate point at the end of each row
+	float *scratch = malloc(sizeof(float) * (numX * gridWidth + numY * gridHeight + 3 * gridRow * (gridHeight + 1) + 3 * gridRow + 4 * width + height));
+	int *runs = malloc(sizeof(int) * (gridWidth + gridHeight + 2));
+	if (!scratch || !runs) {
+		free(scratch); free(runs);
+		return blurhash_stats_end(start, 0, 0, blurhash_error_malloc);
+	}
+	float *cosX = scratch, *cosY = cosX + numX * gridWidth, *grid = cosY + numY * gridHeight;
+	float *vertical = grid + 3 * gridRow * (gridHeight + 1), *srgb = vertical + 3 * gridRow;
+	float *weightX = srgb + 3 * width, *weightY = weightX + width;
+	int *runX = runs, *runY = runs + gridWidth + 1;
+	fillSamplePositions(numX, width, gridWidth, cosX, runX, weightX);
+	fillSamplePositions(numY, height, gridHeight, cosY, runY, weightY);
+
+	// exact basis sums on the grid, converted to unrounded sRGB, as planar rows of [3][gridRow]
+	uint64_t render = blurhash_stats_clock();
+	for(int gy = 0; gy < gridHeight; gy ++) {
+		float *row = grid + gy * 3 * gridRow;
+		float rowColors[numX][3];
+		memset(rowColors, 0, sizeof(rowColors));
+		for(int j = 0; j < numY; j ++) {
+			float basis = cosY[j * gridHeight + gy];
+			for(int i = 0; i < numX; i ++) {
+				rowColors[i][0] += coeffs.colors[i + j * numX][0] * basis;
+				rowColors[i][1] += coeffs.colors[i + j * numX][1] * basis;
+				rowColors[i][2] += coeffs.colors[i + j * numX][2] * basis;
+			}
+		}
+		memset(row, 0, sizeof(float) * 3 * gridRow);
+		for(int i = 0; i < numX; i ++) {
+			blurhash_kernel_add_basis(cosX + i * gridWidth, rowColors[i][0], rowColors[i][1], rowColors[i][2], gridWidth, row, row + gridRow, row + 2 * gridRow);
+		}
+		for(size_t k = 0; k < 3 * gridRow; k ++) row[k] = blurhash_linearTosRGB_unrounded(row[k]);
+		for(int c = 0; c < 3; c ++) row[c * gridRow + gridWidth] = row[c * gridRow + gridWidth - 1];
+	}
+	memcpy(grid + gridHeight * 3 * gridRow, grid + (gridHeight - 1) * 3 * gridRow, sizeof(float) * 3 * gridRow);
+
+	// bilinear upscale in sRGB: a vertical blend of two grid rows, then a horizontal resample of it
+	size_t bytesPerRow = (size_t)width * nChannels;
+	for(int gy = 0; gy < gridHeight; gy ++) {
+		const float *top = grid + gy * 3 * gridRow, *bottom = top + 3 * gridRow;
+		for(int y = runY[gy]; y < runY[gy + 1]; y ++) {
+			float t = weightY[y];
+			for(size_t k = 0; k < 3 * gridRow; k ++) vertical[k] = top[k] + t * (bottom[k] - top[k]);
+			for(int c = 0; c < 3; c ++) {
+				blurhash_kernel_resample_row(vertical + c * gridRow, runX, gridWidth, weightX, srgb + c * width);
+			}
+			blurhash_kernel_pack_row(srgb, srgb + width, srgb + 2 * width, width, nChannels, buffer + y * bytesPerRow);
+		}
+	}
+	blurhash_stats_stage(blurhash_stats_stage_render, render);
+
+	free(scratch);
+	free(runs);
+
+	return blurhash_stats_end(start, pixels, pixels * nChannels, blurhash_error_ok);
 }
 
 blurhash_error_t blurhash_decode_file(const char* blurhash, int width, int height, int punch, int nChannels, const char *filename, uint8_t* buffer) {
+	uint64_t start = blurhash_stats_begin(blurhash_stats_op_decode);
 	blurhash_error_t err = blurhash_decode(blurhash, width, height, punch, nChannels, buffer);
-	if (err) return err;
+	if (err) return blurhash_stats_end(start, 0, 0, err);
 
+	uint64_t write = blurhash_stats_clock();
 	if (stbi_write_png(filename, width, height, nChannels, buffer, nChannels * width) == 0)
-		return blurhash_error_stbi_write_png;
+		err = blurhash_error_stbi_write_png;
+	blurhash_stats_stage(blurhash_stats_stage_write, write);
 
-	return blurhash_error_ok;
+	return blurhash_stats_end(start, (uint64_t)width * height, (uint64_t)width * height * nChannels, err);
 }
@@ -22,34 +22,46 @@
  */
 
 #include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
 #include <stb/stb_image.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include "blurhash.h"
 #include "common.h"
 
-static inline float *multiplyBasisFunction(int xComponent, int yComponent, int width, int height, const uint8_t *rgb) {
-	float r = 0, g = 0, b = 0;
-	float normalisation = (xComponent == 0 && yComponent == 0) ? 1 : 2;
-	int bytesPerRow = width * 3; // rgb
+// multiplyBasisRow: adds one planar linear row (r, g, b of width each) into factors[yComponents][xComponents][3].
+// The row is collapsed into xComponents sums first and then spread over yComponents with
+// basisY[j * basisStride], so the cost is width * xComponents + xComponents * yComponents.
+static inline void multiplyBasisRow(int xComponents, int yComponents, int width, const float *cosX,
+	const float *basisY, int basisStride, const float *linear, float *factors) {
+	float rowSums[xComponents][3];
+	blurhash_kernel_row_sums(cosX, xComponents, width, linear, linear + width, linear + 2 * width, rowSums[0]);
 
-	for(int y = 0; y < height; y++) {
-		for(int x = 0; x < width; x++) {
-			float basis = cosf(M_PI * xComponent * x / width) * cosf(M_PI * yComponent * y / height);
-			r += basis * blurhash_sRGBToLinear(rgb[3 * x + 0 + y * bytesPerRow]);
-			g += basis * blurhash_sRGBToLinear(rgb[3 * x + 1 + y * bytesPerRow]);
-			b += basis * blurhash_sRGBToLinear(rgb[3 * x + 2 + y * bytesPerRow]);
+	for(int j = 0; j < yComponents; j++) {
+		float basis = basisY[j * basisStride];
+		float *factor = factors + j * xComponents * 3;
+		for(int i = 0; i < xComponents; i++) {
+			factor[i * 3 + 0] += basis * rowSums[i][0];
+			factor[i * 3 + 1] += basis * rowSums[i][1];
+			factor[i * 3 + 2] += basis * rowSums[i][2];
 		}
 	}
+}
 
-	float scale = normalisation / (width * height);
-
-	static float result[3];
-	result[0] = r * scale;
-	result[1] = g * scale;
-	result[2] = b * scale;
-
-	return result;
+// multiplyBasisRows: adds the unscaled basis sums of rows [y0, y1) into factors[yComponents][xComponents][3].
+// Each pixel is linearised once, so the cost is pixels * xComponents + rows * xComponents * yComponents
+// instead of pixels * xComponents * yComponents.
+static void multiplyBasisRows(int xComponents, int yComponents, int width, int height, blurhash_format_t format,
+	const uint8_t *pixels, size_t bytesPerRow, int y0, int y1, const float *cosX, const float *cosY, float *linear, float *factors) {
+	for(int y = y0; y < y1; y++) {
+		blurhash_kernel_linearise_row(pixels + y * bytesPerRow, format, width, linear, linear + width, linear + 2 * width);
+		multiplyBasisRow(xComponents, yComponents, width, cosX, cosY + y, height, linear, factors);
+	}
 }
 
 static inline int encodeDC(float r, float g, float b) {
@@ -67,31 +79,22 @@ static inline int encodeAC(float r, float g, float b, float maximumValue) {
 	return quantR * 19 * 19 + quantG * 19 + quantB;
 }
 
-// blurhash_encode: buffer must larger than BLURHASH_ENCODE_BUFSZ
-blurhash_error_t blurhash_encode(int xComponents, int yComponents, int width, int height, const uint8_t *rgb, char* buffer) {
-
-	if(xComponents < 1 || xComponents > 9) {
-		errno = EINVAL;
-		return blurhash_error_invalid_x_components;
-	}
-	if(yComponents < 1 || yComponents > 9) {
-		errno = EINVAL;
-		return blurhash_error_invalid_y_components;
-	}
-
-	float factors[yComponents][xComponents][3];
-	memset(factors, 0, sizeof(factors));
-
+// encodeFactors: normalises the unscaled basis sums factors[yComponents][xComponents][3]
+// of a width x height image in place and writes the quantised hash into buffer.
+static void encodeFactors(int xComponents, int yComponents, int width, int height, float *factors, char* buffer) {
+	uint64_t start = blurhash_stats_clock();
 	for(int y = 0; y < yComponents; y++) {
 		for(int x = 0; x < xComponents; x++) {
-			float *factor = multiplyBasisFunction(x, y, width, height, rgb);
-			factors[y][x][0] = factor[0];
-			factors[y][x][1] = factor[1];
-			factors[y][x][2] = factor[2];
+			float normalisation = (x == 0 && y == 0) ? 1 : 2;
+			float scale = normalisation / ((float)width * height);
+			float *factor = factors + (y * xComponents + x) * 3;
+			factor[0] *= scale;
+			factor[1] *= scale;
+			factor[2] *= scale;
 		}
 	}
 
-	float *dc = factors[0][0];
+	float *dc = factors;
 	float *ac = dc + 3;
 	int acCount = xComponents * yComponents - 1;
 	char *ptr = buffer;
@@ -122,17 +125,486 @@ blurhash_error_t blurhash_encode(int xComponents, int yComponents, int width, in
 
 	*ptr = 0;
 
+	blurhash_stats_stage(blurhash_stats_stage_quantise, start);
+}
+
+// formatBytes: bytes of one pixel of each blurhash_format_t
+static const int formatBytes[] = {3, 4, 3, 4, 1, 6, 8, 2};
+
+// checkPixels: an image of width x height pixels of format needs rows of at least width pixels
+static blurhash_error_t checkPixels(int width, int height, blurhash_format_t format, size_t bytesPerRow) {
+	if(width <= 0 || height <= 0 || bytesPerRow < (size_t)width * formatBytes[format]) {
+		errno = EINVAL;
+		return blurhash_error_invalid_rect;
+	}
+	return blurhash_error_ok;
+}
+
+float *blurhash_scratch_reserve(blurhash_scratch_t *scratch, size_t count) {
+	if(count > scratch->size) {
+		float *data = realloc(scratch->data, sizeof(float) * count);
+		if(!data) return NULL;
+		scratch->data = data;
+		scratch->size = count;
+	}
+	return scratch->data;
+}
+
+blurhash_error_t blurhash_encode_scratch(int xComponents, int yComponents, int width, int height, blurhash_format_t format,
+	const void *pixels, size_t bytesPerRow, char* buffer, blurhash_scratch_t *scratch) {
+	blurhash_error_t err = blurhash_checkComponents(xComponents, yComponents);
+	if(err) return err;
+	if((unsigned)format > blurhash_format_gray16) {
+		errno = EINVAL;
+		return blurhash_error_invalid_format;
+	}
+	err = checkPixels(width, height, format, bytesPerRow);
+	if(err) return err;
+
+	float *cosX = blurhash_scratch_reserve(scratch, xComponents * width + yComponents * height + 3 * width);
+	if(!cosX) return blurhash_error_malloc;
+	float *cosY = cosX + xComponents * width, *linear = cosY + yComponents * height;
+	blurhash_fillBasisTable(xComponents, width, cosX);
+	blurhash_fillBasisTable(yComponents, height, cosY);
+
+	float factors[yComponents][xComponents][3];
+	memset(factors, 0, sizeof(factors));
+
+	uint64_t start = blurhash_stats_clock();
+	multiplyBasisRows(xComponents, yComponents, width, height, format, pixels, bytesPerRow, 0, height, cosX, cosY, linear, factors[0][0]);
+	blurhash_stats_stage(blurhash_stats_stage_accumulate, start);
+
+	encodeFactors(xComponents, yComponents, width, height, factors[0][0], buffer);
+
 	return blurhash_error_ok;
 }
 
-blurhash_error_t blurhash_encode_file(int xComponents, int yComponents, const char *filename, char* buffer) {
-	int width, height, channels;
-	unsigned char *data = stbi_load(filename, &width, &height, &channels, 3);
-	if(!data) return blurhash_error_stbi_load;
+blurhash_error_t blurhash_encode_ctx(blurhash_ctx_t *ctx, int xComponents, int yComponents, int width, int height, blurhash_format_t format, const void *pixels, size_t bytesPerRow, char* buffer) {
+	uint64_t start = blurhash_stats_begin(blurhash_stats_op_encode);
+	blurhash_error_t err = blurhash_checkComponents(xComponents, yComponents);
+	if(err) return blurhash_stats_end(start, 0, 0, err);
+	if((unsigned)format > blurhash_format_gray16) {
+		errno = EINVAL;
+		return blurhash_stats_end(start, 0, 0, blurhash_error_invalid_format);
+	}
+	err = checkPixels(width, height, format, bytesPerRow);
+	if(err) return blurhash_stats_end(start, 0, 0, err);
+
+	const float *cosX = blurhash_ctx_basis(ctx, width, xComponents);
+	const float *cosY = cosX ? blurhash_ctx_basis(ctx, height, yComponents) : NULL;
+	float *linear = blurhash_scratch_reserve(&ctx->scratch, 3 * width);
+	if(!cosY || !linear) return blurhash_stats_end(start, 0, 0, blurhash_error_malloc);
+
+	memset(ctx->factors, 0, sizeof(float) * xComponents * yComponents * 3);
+
+	uint64_t accumulate = blurhash_stats_clock();
+	multiplyBasisRows(xComponents, yComponents, width, height, format, pixels, bytesPerRow, 0, height, cosX, cosY, linear, ctx->factors);
+	blurhash_stats_stage(blurhash_stats_stage_accumulate, accumulate);
+
+	encodeFactors(xComponents, yComponents, width, height, ctx->factors, buffer);
+
+	return blurhash_stats_end(start, (uint64_t)width * height, (uint64_t)bytesPerRow * height, blurhash_error_ok);
+}
+
+blurhash_error_t blurhash_encode_ex(int xComponents, int yComponents, int width, int height, blurhash_format_t format, const void *pixels, size_t bytesPerRow, char* buffer) {
+	uint64_t start = blurhash_stats_begin(blurhash_stats_op_encode);
+	blurhash_scratch_t scratch = {NULL, 0};
+	blurhash_error_t err = blurhash_encode_scratch(xComponents, yComponents, width, height, format, pixels, bytesPerRow, buffer, &scratch);
+	free(scratch.data);
+	return blurhash_stats_end(start, (uint64_t)width * height, (uint64_t)bytesPerRow * height, err);
+}
+
+// blurhash_encode: buffer must larger than BLURHASH_ENCODE_BUFSZ
+blurhash_error_t blurhash_encode(int xComponents, int yComponents, int width, int height, const uint8_t *rgb, char* buffer) {
+	return blurhash_encode_ex(xComponents, yComponents, width, height, blurhash_format_rgb8, rgb, (size_t)width * 3, buffer);
+}
+
+// encodeBand: one horizontal band of blurhash_encode_mt
+struct encodeBand {
+	int xComponents, yComponents, width, height;
+	const uint8_t *rgb;
+	int y0, y1;
+	const float *cosX, *cosY;
+	float *linear, *factors;
+};
+
+static void *encodeBandThread(void *arg) {
+	struct encodeBand *band = (struct encodeBand *)arg;
+	multiplyBasisRows(band->xComponents, band->yComponents, band->width, band->height, blurhash_format_rgb8,
+		band->rgb, (size_t)band->width * 3, band->y0, band->y1, band->cosX, band->cosY, band->linear, band->factors);
+	return NULL;
+}
+
+blurhash_error_t blurhash_encode_mt(int xComponents, int yComponents, int width, int height, const uint8_t *rgb, char* buffer, int nthreads) {
+	blurhash_error_t err = blurhash_checkComponents(xComponents, yComponents);
+	if(err) return err;
+	err = checkPixels(width, height, blurhash_format_rgb8, (size_t)width * 3);
+	if(err) return err;
+
+	if(nthreads <= 0) nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+	if(nthreads > height) nthreads = height;
+	if(nthreads <= 1) return blurhash_encode(xComponents, yComponents, width, height, rgb, buffer);
+
+	uint64_t start = blurhash_stats_begin(blurhash_stats_op_encode);
+	int factorCount = xComponents * yComponents * 3;
+	float *scratch = calloc(xComponents * width + yComponents * height + (size_t)nthreads * (3 * width + factorCount), sizeof(float));
+	struct encodeBand *bands = malloc(sizeof(struct encodeBand) * nthreads);
+	pthread_t *threads = malloc(sizeof(pthread_t) * nthreads);
+	bool *started = calloc(nthreads, sizeof(bool));
+	if(!scratch || !bands || !threads || !started) {
+		free(scratch); free(bands); free(threads); free(started);
+		return blurhash_stats_end(start, 0, 0, blurhash_error_malloc);
+	}
+
+	float *cosX = scratch, *cosY = cosX + xComponents * width, *ptr = cosY + yComponents * height;
+	blurhash_fillBasisTable(xComponents, width, cosX);
+	blurhash_fillBasisTable(yComponents, height, cosY);
+
+	for(int t = 0; t < nthreads; t++) {
+		struct encodeBand *band = &bands[t];
+		band->xComponents = xComponents;
+		band->yComponents = yComponents;
+		band->width = width;
+		band->height = height;
+		band->rgb = rgb;
+		band->y0 = (int)((int64_t)height * t / nthreads);
+		band->y1 = (int)((int64_t)height * (t + 1) / nthreads);
+		band->cosX = cosX;
+		band->cosY = cosY;
+		band->linear = ptr;
+		band->factors = ptr + 3 * width;
+		ptr += 3 * width + factorCount;
+	}
+
+	// band 0 runs on the calling thread, as does any band whose thread could not be created
+	uint64_t accumulate = blurhash_stats_clock();
+	for(int t = 1; t < nthreads; t++) {
+		started[t] = pthread_create(&threads[t], NULL, encodeBandThread, &bands[t]) == 0;
+	}
+	for(int t = 0; t < nthreads; t++) {
+		if(!started[t]) encodeBandThread(&bands[t]);
+	}
+
+	float *factors = bands[0].factors;
+	for(int t = 1; t < nthreads; t++) {
+		if(started[t]) pthread_join(threads[t], NULL);
+		for(int i = 0; i < factorCount; i++) factors[i] += bands[t].factors[i];
+	}
+	blurhash_stats_stage(blurhash_stats_stage_accumulate, accumulate);
+
+	encodeFactors(xComponents, yComponents, width, height, factors, buffer);
+
+	free(scratch); free(bands); free(threads); free(started);
+
+	return blurhash_stats_end(start, (uint64_t)width * height, (uint64_t)width * height * 3, blurhash_error_ok);
+}
+
+// fillCellTable: splits the n pixels of an axis into cells boxes, box c being [bounds[c], bounds[c + 1]),
+// and fills table[i * cells + c] with the basis of component i at the mean pixel position of box c
+static void fillCellTable(int components, int n, int cells, int *bounds, float *table) {
+	for(int c = 0; c <= cells; c++) {
+		bounds[c] = (int)(((int64_t)n * c + cells - 1) / cells);
+	}
+	for(int c = 0; c < cells; c++) {
+		float center = (bounds[c] + bounds[c + 1] - 1) * 0.5f;
+		for(int i = 0; i < components; i++) {
+			table[i * cells + c] = cosf(M_PI * i * center / n);
+		}
+	}
+}
+
+blurhash_error_t blurhash_encode_fast(int xComponents, int yComponents, int width, int height, const uint8_t *rgb, char* buffer) {
+	blurhash_error_t err = blurhash_checkComponents(xComponents, yComponents);
+	if(err) return err;
+	err = checkPixels(width, height, blurhash_format_rgb8, (size_t)width * 3);
+	if(err) return err;
+
+	int longSide = width > height ? width : height;
+	if(longSide <= BLURHASH_FAST_GRID) return blurhash_encode(xComponents, yComponents, width, height, rgb, buffer);
+
+	uint64_t start = blurhash_stats_begin(blurhash_stats_op_encode);
+
+	int gridWidth = (int)((int64_t)width * BLURHASH_FAST_GRID / longSide), gridHeight = (int)((int64_t)height * BLURHASH_FAST_GRID / longSide);
+	if(gridWidth < 1) gridWidth = 1;
+	if(gridHeight < 1) gridHeight = 1;
+
+	int boundsX[gridWidth + 1], boundsY[gridHeight + 1];
+	float cosX[xComponents * gridWidth], cosY[yComponents * gridHeight];
+	fillCellTable(xComponents, width, gridWidth, boundsX, cosX);
+	fillCellTable(yComponents, height, gridHeight, boundsY, cosY);
+
+	float factors[yComponents][xComponents][3];
+	memset(factors, 0, sizeof(factors));
+
+	uint64_t accumulate = blurhash_stats_clock();
+	int bytesPerRow = width * 3; // rgb
+	for(int cy = 0; cy < gridHeight; cy++) {
+		// box sums of one grid row: 16-bit linear values added up exactly in integers
+		uint64_t cells[gridWidth][3];
+		memset(cells, 0, sizeof(cells));
+		for(int y = boundsY[cy]; y < boundsY[cy + 1]; y++) {
+			const uint8_t *px = rgb + y * bytesPerRow;
+			for(int cx = 0; cx < gridWidth; cx++) {
+				uint32_t r = 0, g = 0, b = 0;
+				const uint8_t *end = rgb + y * bytesPerRow + 3 * boundsX[cx + 1];
+				for(; px < end; px += 3) {
+					r += blurhash_sRGBToLinear16_table[px[0]];
+					g += blurhash_sRGBToLinear16_table[px[1]];
+					b += blurhash_sRGBToLinear16_table[px[2]];
+				}
+				cells[cx][0] += r;
+				cells[cx][1] += g;
+				cells[cx][2] += b;
+			}
+		}
+
+		float linear[3][gridWidth];
+		for(int cx = 0; cx < gridWidth; cx++) {
+			linear[0][cx] = cells[cx][0] / 65535.0f;
+			linear[1][cx] = cells[cx][1] / 65535.0f;
+			linear[2][cx] = cells[cx][2] / 65535.0f;
+		}
+
+		multiplyBasisRow(xComponents, yComponents, gridWidth, cosX, cosY + cy, gridHeight, linear[0], factors[0][0]);
+	}
+	blurhash_stats_stage(blurhash_stats_stage_accumulate, accumulate);
+
+	encodeFactors(xComponents, yComponents, width, height, factors[0][0], buffer);
+
+	return blurhash_stats_end(start, (uint64_t)width * height, (uint64_t)width * height * 3, blurhash_error_ok);
+}
+
+struct blurhash_encoder_t {
+	int xComponents, yComponents, width, height;
+	int y; // next row to be pushed
+	uint64_t accumulateNs; // stats of the pushes, reported by blurhash_encoder_finish
+	float factors[9 * 9 * 3];
+	float *linear; // [3][width]
+	float cosX[]; // [xComponents][width]
+};
+
+blurhash_error_t blurhash_encoder_begin(blurhash_encoder_t **encoder, int xComponents, int yComponents, int width, int height) {
+	blurhash_error_t err = blurhash_checkComponents(xComponents, yComponents);
+	if(err) return err;
+	if(width < 1 || height < 1) {
+		errno = EINVAL;
+		return blurhash_error_invalid_rows;
+	}
+
+	blurhash_encoder_t *enc = malloc(sizeof(blurhash_encoder_t) + sizeof(float) * (xComponents + 3) * width);
+	if(!enc) return blurhash_error_malloc;
+
+	enc->xComponents = xComponents;
+	enc->yComponents = yComponents;
+	enc->width = width;
+	enc->height = height;
+	enc->y = 0;
+	enc->accumulateNs = 0;
+	memset(enc->factors, 0, sizeof(enc->factors));
+	enc->linear = enc->cosX + xComponents * width;
+	blurhash_fillBasisTable(xComponents, width, enc->cosX);
+
+	*encoder = enc;
+	return blurhash_error_ok;
+}
+
+blurhash_error_t blurhash_encoder_push_rows(blurhash_encoder_t *encoder, const uint8_t *rows, int count, size_t stride) {
+	if(count < 0 || count > encoder->height - encoder->y) {
+		errno = EINVAL;
+		return blurhash_error_invalid_rows;
+	}
+
+	uint64_t start = blurhash_stats_clock();
+	for(int n = 0; n < count; n++, encoder->y++) {
+		float basisY[encoder->yComponents];
+		for(int j = 0; j < encoder->yComponents; j++) {
+			basisY[j] = cosf(M_PI * j * encoder->y / encoder->height);
+		}
+
+		float *linear = encoder->linear;
+		blurhash_kernel_linearise_row(rows + n * stride, blurhash_format_rgb8, encoder->width, linear, linear + encoder->width, linear + 2 * encoder->width);
+		multiplyBasisRow(encoder->xComponents, encoder->yComponents, encoder->width, encoder->cosX, basisY, 1, linear, encoder->factors);
+	}
+	encoder->accumulateNs += blurhash_stats_since(start);
+
+	return blurhash_error_ok;
+}
+
+blurhash_error_t blurhash_encoder_finish(blurhash_encoder_t *encoder, char* buffer) {
+	uint64_t start = blurhash_stats_begin(blurhash_stats_op_encode);
+	if(start) blurhash_stats_add(blurhash_stats_stage_accumulate, encoder->accumulateNs);
+	uint64_t pixels = (uint64_t)encoder->width * encoder->y;
+	blurhash_error_t err = blurhash_error_ok;
+	if(encoder->y != encoder->height) {
+		errno = EINVAL;
+		err = blurhash_error_invalid_rows;
+	} else {
+		encodeFactors(encoder->xComponents, encoder->yComponents, encoder->width, encoder->height, encoder->factors, buffer);
+	}
+	free(encoder);
+	return blurhash_stats_end(start, pixels, pixels * 3, err);
+}
+
+void blurhash_encoder_free(blurhash_encoder_t *encoder) {
+	free(encoder);
+}
+
+struct blurhash_state_t {
+	int xComponents, yComponents, width, height;
+	blurhash_format_t format;
+	double factors[9 * 9 * 3]; // unscaled basis sums [yComponents][xComponents][3]
+	float *cosY; // [yComponents][height]
+	float *linear; // [6][width], old and new rows of a region
+	float *regionX; // [xComponents][width], cosX of the columns of a region
+	float cosX[]; // [xComponents][width]
+};
+
+// addRowSums: factors[j][i][c] += basisY[j * basisStride] * rowSums[i][c], in double
+static inline void addRowSums(int xComponents, int yComponents, const float *basisY, int basisStride, const float *rowSums, double *factors) {
+	for(int j = 0; j < yComponents; j++) {
+		double basis = basisY[j * basisStride];
+		double *factor = factors + j * xComponents * 3;
+		for(int i = 0; i < xComponents * 3; i++) {
+			factor[i] += basis * rowSums[i];
+		}
+	}
+}
+
+// encodeState: writes the hash of the sums of state to buffer
+static void encodeState(const blurhash_state_t *state, char* buffer) {
+	int count = state->xComponents * state->yComponents * 3;
+	float factors[count];
+	for(int i = 0; i < count; i++) factors[i] = state->factors[i];
+	encodeFactors(state->xComponents, state->yComponents, state->width, state->height, factors, buffer);
+}
+
+blurhash_error_t blurhash_encode_state(blurhash_state_t **state, int xComponents, int yComponents, int width, int height, blurhash_format_t format, const void *pixels, size_t bytesPerRow, char* buffer) {
+	uint64_t start = blurhash_stats_begin(blurhash_stats_op_encode);
+	blurhash_error_t err = blurhash_checkComponents(xComponents, yComponents);
+	if(err) return blurhash_stats_end(start, 0, 0, err);
+	if((unsigned)format > blurhash_format_gray16) {
+		errno = EINVAL;
+		return blurhash_stats_end(start, 0, 0, blurhash_error_invalid_format);
+	}
+	err = checkPixels(width, height, format, bytesPerRow);
+	if(err) return blurhash_stats_end(start, 0, 0, err);
+
+	blurhash_state_t *st = malloc(sizeof(blurhash_state_t) + sizeof(float) * ((2 * xComponents + 6) * (size_t)width + (size_t)yComponents * height));
+	if(!st) return blurhash_stats_end(start, 0, 0, blurhash_error_malloc);
+
+	st->xComponents = xComponents;
+	st->yComponents = yComponents;
+	st->width = width;
+	st->height = height;
+	st->format = format;
+	memset(st->factors, 0, sizeof(st->factors));
+	st->regionX = st->cosX + xComponents * width;
+	st->linear = st->regionX + xComponents * width;
+	st->cosY = st->linear + 6 * width;
+	blurhash_fillBasisTable(xComponents, width, st->cosX);
+	blurhash_fillBasisTable(yComponents, height, st->cosY);
+
+	uint64_t accumulate = blurhash_stats_clock();
+	float *linear = st->linear;
+	for(int y = 0; y < height; y++) {
+		float rowSums[xComponents][3];
+		blurhash_kernel_linearise_row((const uint8_t *)pixels + y * bytesPerRow, format, width, linear, linear + width, linear + 2 * width);
+		blurhash_kernel_row_sums(st->cosX, xComponents, width, linear, linear + width, linear + 2 * width, rowSums[0]);
+		addRowSums(xComponents, yComponents, st->cosY + y, height, rowSums[0], st->factors);
+	}
+	blurhash_stats_stage(blurhash_stats_stage_accumulate, accumulate);
+
+	encodeState(st, buffer);
+
+	*state = st;
+	return blurhash_stats_end(start, (uint64_t)width * height, (uint64_t)bytesPerRow * height, blurhash_error_ok);
+}
+
+blurhash_error_t blurhash_state_update_region(blurhash_state_t *state, int x0, int y0, int width, int height, const void *oldPixels, size_t oldBytesPerRow, const void *newPixels, size_t newBytesPerRow, char* buffer) {
+	uint64_t start = blurhash_stats_begin(blurhash_stats_op_encode);
+	if(x0 < 0 || y0 < 0 || width < 0 || height < 0 || width > state->width - x0 || height > state->height - y0
+		|| oldBytesPerRow < (size_t)width * formatBytes[state->format] || newBytesPerRow < (size_t)width * formatBytes[state->format]) {
+		errno = EINVAL;
+		return blurhash_stats_end(start, 0, 0, blurhash_error_invalid_rect);
+	}
+
+	int xComponents = state->xComponents;
+	for(int i = 0; i < xComponents; i++) {
+		memcpy(state->regionX + i * width, state->cosX + i * state->width + x0, sizeof(float) * width);
+	}
+
+	uint64_t accumulate = blurhash_stats_clock();
+	float *before = state->linear, *after = before + 3 * width;
+	for(int y = 0; y < height; y++) {
+		float rowSums[xComponents][3];
+		blurhash_kernel_linearise_row((const uint8_t *)oldPixels + y * oldBytesPerRow, state->format, width, before, before + width, before + 2 * width);
+		blurhash_kernel_linearise_row((const uint8_t *)newPixels + y * newBytesPerRow, state->format, width, after, after + width, after + 2 * width);
+		for(int x = 0; x < 3 * width; x++) after[x] -= before[x];
+		blurhash_kernel_row_sums(state->regionX, xComponents, width, after, after + width, after + 2 * width, rowSums[0]);
+		addRowSums(xComponents, state->yComponents, state->cosY + y0 + y, state->height, rowSums[0], state->factors);
+	}
+	blurhash_stats_stage(blurhash_stats_stage_accumulate, accumulate);
+
+	encodeState(state, buffer);
+
+	return blurhash_stats_end(start, (uint64_t)width * height, (oldBytesPerRow + newBytesPerRow) * height, blurhash_error_ok);
+}
+
+void blurhash_state_free(blurhash_state_t *state) {
+	free(state);
+}
+
+unsigned char *blurhash_load_file(const char *filename, int *width, int *height) {
+	int channels;
+	int fd = open(filename, O_RDONLY | O_CLOEXEC);
+	if(fd < 0) return NULL;
+
+	struct stat st;
+	if(fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0 && st.st_size <= INT_MAX) {
+		void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if(map != MAP_FAILED) {
+			close(fd);
+			madvise(map, st.st_size, MADV_WILLNEED);
+			unsigned char *data = stbi_load_from_memory(map, (int)st.st_size, width, height, &channels, 3);
+			munmap(map, st.st_size);
+			return data;
+		}
+	}
+	close(fd);
+
+	// pipes, devices and files that cannot be mapped go through stdio
+	return stbi_load(filename, width, height, &channels, 3);
+}
+
+// encodeLoaded: encodes and frees data as loaded by stbi, ending the stats call started at start
+static blurhash_error_t encodeLoaded(uint64_t start, int xComponents, int yComponents, unsigned char *data, int width, int height, char* buffer) {
+	if(!data) return blurhash_stats_end(start, 0, 0, blurhash_error_stbi_load);
 
 	blurhash_error_t err = blurhash_encode(xComponents, yComponents, width, height, data, buffer);
 
 	stbi_image_free(data);
 
-	return err;
+	return blurhash_stats_end(start, (uint64_t)width * height, (uint64_t)width * height * 3, err);
+}
+
+blurhash_error_t blurhash_encode_file(int xComponents, int yComponents, const char *filename, char* buffer) {
+	uint64_t start = blurhash_stats_begin(blurhash_stats_op_encode);
+	int width, height;
+	uint64_t load = blurhash_stats_clock();
+	unsigned char *data = blurhash_load_file(filename, &width, &height);
+	blurhash_stats_stage(blurhash_stats_stage_load, load);
+	return encodeLoaded(start, xComponents, yComponents, data, width, height, buffer);
+}
+
+blurhash_error_t blurhash_encode_memory(int xComponents, int yComponents, const void *data, size_t size, char* buffer) {
+	uint64_t start = blurhash_stats_begin(blurhash_stats_op_encode);
+	if(!data || !size || size > INT_MAX) {
+		errno = EINVAL;
+		return blurhash_stats_end(start, 0, 0, blurhash_error_stbi_load);
+	}
+	int width, height, channels;
+	uint64_t load = blurhash_stats_clock();
+	unsigned char *pixels = stbi_load_from_memory(data, (int)size, &width, &height, &channels, 3);
+	blurhash_stats_stage(blurhash_stats_stage_load, load);
+	return encodeLoaded(start, xComponents, yComponents, pixels, width, height, buffer);
 }
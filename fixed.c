@@ -0,0 +1,212 @@
+/* fixed.c
+ * This file is part of the blurhash distribution (https://github.com/fumiama/blurhash).
+ * Copyright (c) 2018 Wolt Enterprises and Copyright (c) 2025 Fumiama Minamoto.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <errno.h>
+
+#include "blurhash.h"
+#include "common.h"
+
+// The tables below were generated once in double precision and are part of the format of this
+// engine: nothing here depends on the floating point unit, libm or the compiler flags.
+
+// sRGBToLinearQ15[v] is round(sRGBToLinear(v) * 2^15)
+static const int32_t sRGBToLinearQ15[256] = {
+	0, 10, 20, 30, 40, 50, 60, 70, 80, 90, 99, 110, 120, 132, 144, 157,
+	170, 184, 198, 213, 229, 246, 263, 281, 299, 319, 338, 359, 381, 403, 425, 449,
+	473, 498, 524, 551, 578, 606, 635, 665, 695, 727, 759, 792, 825, 860, 895, 931,
+	969, 1006, 1045, 1085, 1125, 1167, 1209, 1252, 1296, 1341, 1386, 1433, 1481, 1529, 1578, 1629,
+	1680, 1732, 1785, 1839, 1894, 1950, 2007, 2065, 2123, 2183, 2244, 2306, 2368, 2432, 2496, 2562,
+	2629, 2696, 2765, 2834, 2905, 2977, 3049, 3123, 3198, 3273, 3350, 3428, 3507, 3587, 3668, 3750,
+	3833, 3917, 4002, 4089, 4176, 4264, 4354, 4444, 4536, 4629, 4723, 4818, 4914, 5011, 5109, 5209,
+	5309, 5411, 5514, 5618, 5723, 5829, 5936, 6045, 6155, 6265, 6377, 6490, 6605, 6720, 6837, 6954,
+	7073, 7193, 7315, 7437, 7561, 7686, 7812, 7939, 8068, 8197, 8328, 8460, 8593, 8728, 8864, 9001,
+	9139, 9278, 9419, 9561, 9704, 9848, 9994, 10141, 10289, 10438, 10589, 10741, 10894, 11048, 11204, 11361,
+	11519, 11679, 11839, 12001, 12165, 12329, 12495, 12663, 12831, 13001, 13172, 13344, 13518, 13693, 13870, 14047,
+	14226, 14407, 14588, 14771, 14956, 15141, 15328, 15517, 15706, 15897, 16090, 16284, 16479, 16675, 16873, 17072,
+	17273, 17474, 17678, 17882, 18088, 18296, 18504, 18715, 18926, 19139, 19353, 19569, 19786, 20005, 20225, 20446,
+	20669, 20893, 21118, 21345, 21574, 21803, 22035, 22267, 22501, 22737, 22974, 23212, 23452, 23693, 23936, 24180,
+	24425, 24672, 24921, 25171, 25422, 25675, 25929, 26185, 26442, 26701, 26961, 27223, 27486, 27750, 28016, 28284,
+	28553, 28823, 29095, 29369, 29644, 29920, 30198, 30478, 30759, 31041, 31325, 31611, 31898, 32186, 32476, 32768,
+};
+
+// sRGBThresholdQ15[k - 1] is the smallest linear value in Q15 that rounds to sRGB k
+static const int32_t sRGBThresholdQ15[255] = {
+	5, 15, 25, 35, 45, 55, 65, 75, 85, 95, 105, 115, 127, 138, 151, 164,
+	177, 191, 206, 222, 238, 255, 272, 290, 309, 329, 349, 370, 392, 414, 438, 462,
+	486, 512, 538, 565, 593, 621, 650, 680, 711, 743, 776, 809, 843, 878, 914, 950,
+	988, 1026, 1065, 1105, 1146, 1188, 1231, 1274, 1319, 1364, 1410, 1457, 1505, 1554, 1604, 1655,
+	1706, 1759, 1813, 1867, 1922, 1979, 2036, 2094, 2154, 2214, 2275, 2337, 2400, 2465, 2530, 2596,
+	2663, 2731, 2800, 2870, 2941, 3013, 3087, 3161, 3236, 3312, 3390, 3468, 3547, 3628, 3709, 3792,
+	3875, 3960, 4046, 4133, 4220, 4309, 4399, 4491, 4583, 4676, 4771, 4866, 4963, 5061, 5159, 5259,
+	5361, 5463, 5566, 5671, 5776, 5883, 5991, 6100, 6210, 6322, 6434, 6548, 6663, 6779, 6896, 7014,
+	7134, 7254, 7376, 7499, 7624, 7749, 7876, 8004, 8133, 8263, 8394, 8527, 8661, 8796, 8932, 9070,
+	9209, 9349, 9490, 9633, 9776, 9921, 10068, 10215, 10364, 10514, 10665, 10818, 10971, 11126, 11283, 11440,
+	11599, 11759, 11921, 12083, 12247, 12413, 12579, 12747, 12916, 13087, 13259, 13432, 13606, 13782, 13959, 14137,
+	14317, 14498, 14680, 14864, 15049, 15235, 15423, 15612, 15802, 15994, 16187, 16381, 16577, 16774, 16973, 17173,
+	17374, 17576, 17780, 17986, 18192, 18400, 18610, 18821, 19033, 19247, 19462, 19678, 19896, 20115, 20336, 20558,
+	20781, 21006, 21232, 21460, 21689, 21919, 22151, 22385, 22619, 22856, 23093, 23332, 23573, 23815, 24058, 24303,
+	24549, 24797, 25046, 25297, 25549, 25802, 26057, 26314, 26572, 26831, 27092, 27355, 27618, 27884, 28150, 28419,
+	28689, 28960, 29233, 29507, 29782, 30060, 30338, 30619, 30900, 31184, 31468, 31755, 32042, 32332, 32623,
+};
+
+// quarterCosQ14[i] is round(cos(pi / 2 * i / 256) * 2^14)
+static const int32_t quarterCosQ14[257] = {
+	16384, 16384, 16383, 16381, 16379, 16376, 16373, 16369, 16364, 16359, 16353, 16347, 16340, 16332, 16324, 16315,
+	16305, 16295, 16284, 16273, 16261, 16248, 16235, 16221, 16207, 16192, 16176, 16160, 16143, 16125, 16107, 16088,
+	16069, 16049, 16029, 16008, 15986, 15964, 15941, 15917, 15893, 15868, 15843, 15817, 15791, 15763, 15736, 15707,
+	15679, 15649, 15619, 15588, 15557, 15525, 15493, 15460, 15426, 15392, 15357, 15322, 15286, 15250, 15213, 15175,
+	15137, 15098, 15059, 15019, 14978, 14937, 14896, 14854, 14811, 14768, 14724, 14680, 14635, 14589, 14543, 14497,
+	14449, 14402, 14354, 14305, 14256, 14206, 14155, 14104, 14053, 14001, 13949, 13896, 13842, 13788, 13733, 13678,
+	13623, 13567, 13510, 13453, 13395, 13337, 13279, 13219, 13160, 13100, 13039, 12978, 12916, 12854, 12792, 12729,
+	12665, 12601, 12537, 12472, 12406, 12340, 12274, 12207, 12140, 12072, 12004, 11935, 11866, 11797, 11727, 11656,
+	11585, 11514, 11442, 11370, 11297, 11224, 11151, 11077, 11003, 10928, 10853, 10778, 10702, 10625, 10549, 10471,
+	10394, 10316, 10238, 10159, 10080, 10001, 9921, 9841, 9760, 9679, 9598, 9516, 9434, 9352, 9269, 9186,
+	9102, 9019, 8935, 8850, 8765, 8680, 8595, 8509, 8423, 8337, 8250, 8163, 8076, 7988, 7900, 7812,
+	7723, 7635, 7545, 7456, 7366, 7276, 7186, 7096, 7005, 6914, 6823, 6731, 6639, 6547, 6455, 6363,
+	6270, 6177, 6084, 5990, 5897, 5803, 5708, 5614, 5520, 5425, 5330, 5235, 5139, 5044, 4948, 4852,
+	4756, 4660, 4563, 4467, 4370, 4273, 4176, 4078, 3981, 3883, 3786, 3688, 3590, 3492, 3393, 3295,
+	3196, 3098, 2999, 2900, 2801, 2702, 2603, 2503, 2404, 2305, 2205, 2105, 2006, 1906, 1806, 1706,
+	1606, 1506, 1406, 1306, 1205, 1105, 1005, 904, 804, 704, 603, 503, 402, 302, 201, 101,
+	0,
+};
+
+uint8_t blurhash_linearQ15TosRGB_table[BLURHASH_Q15_ONE + 1];
+
+// fixedInitTables: expands sRGBThresholdQ15 into a direct lookup table when the library is loaded
+__attribute__((constructor)) static void fixedInitTables(void) {
+	int k = 0;
+	for(int v = 0; v <= BLURHASH_Q15_ONE; v++) {
+		while(k < 255 && v >= sRGBThresholdQ15[k]) k++;
+		blurhash_linearQ15TosRGB_table[v] = k;
+	}
+}
+
+// quarterCos: cos(pi / 2 * x / 2^30) in Q14 for x in [0, 2^30], interpolated between table entries
+static inline int32_t quarterCos(uint32_t x) {
+	uint32_t i = x >> 22, rem = x & ((1 << 22) - 1);
+	if(i == 256) return quarterCosQ14[256];
+	int64_t delta = quarterCosQ14[i + 1] - quarterCosQ14[i];
+	return quarterCosQ14[i] + (int32_t)((delta * rem + (1 << 21)) >> 22);
+}
+
+// fixedCos: cos(pi * k / n) in Q14
+static int32_t fixedCos(int64_t k, int n) {
+	uint32_t phase = (uint32_t)(((uint64_t)(k % (2 * (int64_t)n)) << 32) / (2 * (uint64_t)n)); // a full turn is 2^32
+	uint32_t f = phase & ((1u << 30) - 1);
+	switch(phase >> 30) {
+		case 0: return quarterCos(f);
+		case 1: return -quarterCos((1u << 30) - f);
+		case 2: return -quarterCos(f);
+		default: return quarterCos((1u << 30) - f);
+	}
+}
+
+// fillFixedBasis: table[i * n + p] = cos(pi * i * p / n) in Q14 for i in [0, components)
+static void fillFixedBasis(int components, int n, int32_t *table) {
+	for(int i = 0; i < components; i++) {
+		for(int p = 0; p < n; p++) {
+			table[i * n + p] = fixedCos((int64_t)i * p, n);
+		}
+	}
+}
+
+// roundShift: value / 2^shift rounded half up, on an arithmetic right shift
+static inline int64_t roundShift(int64_t value, int shift) {
+	return (value + ((int64_t)1 << (shift - 1))) >> shift;
+}
+
+// FIXED_ROW_LIMIT saturates the per-row colours, keeping every product of blurhash_kernel_add_basis_fixed
+// within 32 bits; it is 4 in linear light, never reached below a punch of 2
+#define FIXED_ROW_LIMIT ((1 << 17) - 1)
+
+// FIXED_COLOR_BITS are kept below Q15 in the colours up to the row collapse: hashes repeat the same digits,
+// so at the edges, where every basis is +-1, the rounding errors of the colours would add up instead of cancelling
+#define FIXED_COLOR_BITS 8
+
+// FIXED_PUNCH_LIMIT keeps the colours within 64 bits; from there on every AC colour is over 75 in linear light
+#define FIXED_PUNCH_LIMIT (1 << 20)
+
+blurhash_error_t blurhash_decode_fixed(const char * blurhash, int width, int height, int punch, int nChannels, uint8_t* buffer) {
+	uint64_t start = blurhash_stats_begin(blurhash_stats_op_decode);
+	uint64_t parse = blurhash_stats_clock();
+	if (! blurhash_is_valid(blurhash)) {
+		errno = EINVAL;
+		return blurhash_stats_end(start, 0, 0, blurhash_error_invalid_hash);
+	}
+	if (punch < 1) punch = 1;
+	if (punch > FIXED_PUNCH_LIMIT) punch = FIXED_PUNCH_LIMIT;
+
+	int sizeFlag = blurhash_base83_decode_int(blurhash, 0, 1);
+	int numY = sizeFlag / 9 + 1;
+	int numX = sizeFlag % 9 + 1;
+
+	// the maximum AC value is (quantizedMaxValue + 1) / 166 and AC = ((quant - 9) / 9)^2 * sign * maximum
+	int64_t acScale = (int64_t)(blurhash_base83_decode_int(blurhash, 1, 2) + 1) * punch;
+
+	// colours in Q15 + FIXED_COLOR_BITS
+	int64_t colors[numY * numX][3];
+	int dc = blurhash_base83_decode_int(blurhash, 2, 6);
+	int red = dc >> 16; // up to 83^4 - 1 >> 16, saturated as in decodeDC
+	colors[0][0] = (int64_t)sRGBToLinearQ15[red > 255 ? 255 : red] << FIXED_COLOR_BITS;
+	colors[0][1] = (int64_t)sRGBToLinearQ15[(dc >> 8) & 255] << FIXED_COLOR_BITS;
+	colors[0][2] = (int64_t)sRGBToLinearQ15[dc & 255] << FIXED_COLOR_BITS;
+	for(int iter = 1; iter < numX * numY; iter ++) {
+		int value = blurhash_base83_decode_int(blurhash, 4 + iter * 2, 6 + iter * 2);
+		int quant[3] = {value / (19 * 19), value / 19 % 19, value % 19};
+		for(int c = 0; c < 3; c ++) {
+			int64_t q = quant[c] - 9;
+			int64_t numerator = q * (q < 0 ? -q : q) * acScale * ((int64_t)BLURHASH_Q15_ONE << FIXED_COLOR_BITS), denominator = 81 * 166;
+			colors[iter][c] = (numerator + (numerator < 0 ? -denominator : denominator) / 2) / denominator;
+		}
+	}
+	blurhash_stats_stage(blurhash_stats_stage_parse, parse);
+
+	int32_t *scratch = malloc(sizeof(int32_t) * (numX * width + numY * height + 3 * width));
+	if (!scratch) return blurhash_stats_end(start, 0, 0, blurhash_error_malloc);
+	int32_t *cosX = scratch, *cosY = cosX + numX * width, *lr = cosY + numY * height, *lg = lr + width, *lb = lg + width;
+	fillFixedBasis(numX, width, cosX);
+	fillFixedBasis(numY, height, cosY);
+
+	uint64_t render = blurhash_stats_clock();
+	for(int y = 0; y < height; y ++) {
+		memset(lr, 0, sizeof(int32_t) * 3 * width);
+		for(int i = 0; i < numX; i ++) {
+			int64_t sums[3] = {0, 0, 0};
+			for(int j = 0; j < numY; j ++) {
+				for(int c = 0; c < 3; c ++) sums[c] += colors[j * numX + i][c] * cosY[j * height + y];
+			}
+			int32_t rowColor[3];
+			for(int c = 0; c < 3; c ++) {
+				int64_t v = roundShift(sums[c], 14 + FIXED_COLOR_BITS);
+				rowColor[c] = v > FIXED_ROW_LIMIT ? FIXED_ROW_LIMIT : v < -FIXED_ROW_LIMIT ? -FIXED_ROW_LIMIT : v;
+			}
+			blurhash_kernel_add_basis_fixed(cosX + i * width, rowColor[0], rowColor[1], rowColor[2], width, lr, lg, lb);
+		}
+		blurhash_kernel_store_row_fixed(lr, lg, lb, width, nChannels, buffer + (size_t)y * width * nChannels);
+	}
+	blurhash_stats_stage(blurhash_stats_stage_render, render);
+
+	free(scratch);
+
+	return blurhash_stats_end(start, (uint64_t)width * height, (uint64_t)width * height * nChannels, blurhash_error_ok);
+}
@@ -0,0 +1,372 @@
+/* golden.c
+ * This file is part of the blurhash distribution (https://github.com/fumiama/blurhash).
+ * Copyright (c) 2018 Wolt Enterprises and Copyright (c) 2025 Fumiama Minamoto.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+// blurhash_golden: encodes and decodes fixed images and hashes and compares them with known results, run by ctest.
+// The encode hashes were produced by the original per-pixel encoder. Every exact encode engine must still reproduce
+// them: blurhash_encode, _mt, _ex on padded bgra rows, _ctx, _state, the row-push encoder and the batch pool;
+// blurhash_encode_fast approximates and is held to its error bound by `blurhash_bench --check` instead.
+// Float decodes depend on the instruction set and the compiler, so the decode results pinned here are those of
+// blurhash_decode_fixed, which is integer-only and bit-identical everywhere; blurhash_decode is then required to stay
+// within 1 of it, the bound documented for blurhash_decode_fixed, which is also checked on every hash of goldenHashes
+// at sizes up to 1920x1080.
+// `blurhash_golden --print` writes the tables of the current build, to review a deliberate change of results.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "blurhash.h"
+
+// fillImage: a width x height rgb image of pattern, from integer arithmetic only so it is the same everywhere
+static void fillImage(int pattern, int width, int height, uint8_t *rgb) {
+	uint64_t state = 0x9E3779B97F4A7C15ULL + pattern;
+	for(int y = 0; y < height; y++) {
+		for(int x = 0; x < width; x++) {
+			uint8_t *px = rgb + ((size_t)y * width + x) * 3;
+			int dx = x - width / 3, dy = y - height / 2;
+			switch(pattern) {
+				case 0: // gradient
+					px[0] = x * 255 / (width > 1 ? width - 1 : 1);
+					px[1] = y * 255 / (height > 1 ? height - 1 : 1);
+					px[2] = (x + y) * 127 / (width + height);
+					break;
+				case 1: // noise, xorshift64*
+					state ^= state >> 12;
+					state ^= state << 25;
+					state ^= state >> 27;
+					uint32_t noise = (state * 0x2545F4914F6CDD1DULL) >> 32;
+					px[0] = noise;
+					px[1] = noise >> 8;
+					px[2] = noise >> 16;
+					break;
+				case 2: // a disc on a vertical gradient
+					if(dx * dx + dy * dy < width * width / 16) {
+						px[0] = 230, px[1] = 120, px[2] = 30;
+					} else {
+						px[0] = 40, px[1] = y * 200 / height, px[2] = 180;
+					}
+					break;
+				default: // stripes of three frequencies
+					px[0] = (x * 37 + y * 11) % 256;
+					px[1] = (x / 4 % 2) * 200 + 20;
+					px[2] = ((x * x + 3 * y) % 97) * 255 / 96;
+					break;
+			}
+		}
+	}
+}
+
+// encode engines, each of which must give exactly the hashes of blurhash_encode
+
+static blurhash_error_t encodeMt(int xComponents, int yComponents, int width, int height, const uint8_t *rgb, char *hash) {
+	return blurhash_encode_mt(xComponents, yComponents, width, height, rgb, hash, 4);
+}
+
+// encodeBGRA: blurhash_encode_ex on a bgra copy of the image with padded rows
+static blurhash_error_t encodeBGRA(int xComponents, int yComponents, int width, int height, const uint8_t *rgb, char *hash) {
+	static uint8_t bgra[200 * 133 * 4 + 133 * 8];
+	size_t bytesPerRow = (size_t)width * 4 + 8;
+	for(int y = 0; y < height; y++) {
+		for(int x = 0; x < width; x++) {
+			const uint8_t *px = rgb + ((size_t)y * width + x) * 3;
+			uint8_t *out = bgra + y * bytesPerRow + x * 4;
+			out[0] = px[2], out[1] = px[1], out[2] = px[0], out[3] = 255;
+		}
+	}
+	return blurhash_encode_ex(xComponents, yComponents, width, height, blurhash_format_bgra8, bgra, bytesPerRow, hash);
+}
+
+static blurhash_ctx_t *ctx;
+
+static blurhash_error_t encodeCtx(int xComponents, int yComponents, int width, int height, const uint8_t *rgb, char *hash) {
+	if(!ctx && blurhash_ctx_create(&ctx)) return blurhash_error_malloc;
+	return blurhash_encode_ctx(ctx, xComponents, yComponents, width, height, blurhash_format_rgb8, rgb, (size_t)width * 3, hash);
+}
+
+static blurhash_error_t encodeState(int xComponents, int yComponents, int width, int height, const uint8_t *rgb, char *hash) {
+	blurhash_state_t *state;
+	blurhash_error_t err = blurhash_encode_state(&state, xComponents, yComponents, width, height, blurhash_format_rgb8, rgb, (size_t)width * 3, hash);
+	if(!err) blurhash_state_free(state);
+	return err;
+}
+
+// encodeRows: the row-push encoder, fed 16 rows at a time
+static blurhash_error_t encodeRows(int xComponents, int yComponents, int width, int height, const uint8_t *rgb, char *hash) {
+	blurhash_encoder_t *encoder;
+	blurhash_error_t err = blurhash_encoder_begin(&encoder, xComponents, yComponents, width, height);
+	if(err) return err;
+	for(int y = 0; y < height; y += 16) {
+		err = blurhash_encoder_push_rows(encoder, rgb + (size_t)y * width * 3, height - y < 16 ? height - y : 16, (size_t)width * 3);
+		if(err) {
+			blurhash_encoder_free(encoder);
+			return err;
+		}
+	}
+	return blurhash_encoder_finish(encoder, hash);
+}
+
+// encodeBatch: two items of the same image on two threads, which must agree
+static blurhash_error_t encodeBatch(int xComponents, int yComponents, int width, int height, const uint8_t *rgb, char *hash) {
+	blurhash_batch_item_t items[2];
+	for(int i = 0; i < 2; i++) items[i] = (blurhash_batch_item_t){.filename = NULL, .rgb = rgb, .width = width, .height = height};
+	blurhash_error_t err = blurhash_encode_batch(xComponents, yComponents, items, 2, 2);
+	if(!err) err = items[0].err ? items[0].err : items[1].err;
+	if(err) return err;
+	if(strcmp(items[0].hash, items[1].hash)) return blurhash_error_invalid_hash;
+	strcpy(hash, items[0].hash);
+	return blurhash_error_ok;
+}
+
+static const struct {
+	const char *name;
+	blurhash_error_t (*encode)(int xComponents, int yComponents, int width, int height, const uint8_t *rgb, char *hash);
+} encodeEngines[] = {
+	{"encode", blurhash_encode},
+	{"mt", encodeMt},
+	{"bgra_stride", encodeBGRA},
+	{"ctx", encodeCtx},
+	{"state", encodeState},
+	{"rows", encodeRows},
+	{"batch", encodeBatch},
+};
+#define ENGINES (sizeof(encodeEngines) / sizeof(encodeEngines[0]))
+
+#define PATTERNS 4
+static const int sizes[][2] = {{7, 5}, {64, 48}, {200, 133}};
+static const int components[][2] = {{1, 1}, {4, 3}, {3, 7}, {9, 9}, {5, 5}};
+#define SIZES (sizeof(sizes) / sizeof(sizes[0]))
+#define COMPONENTS (sizeof(components) / sizeof(components[0]))
+
+// goldenHashes[pattern][size][components]
+static const char *goldenHashes[PATTERNS][SIZES][COMPONENTS] = {
+	{
+		{"00IF5l", "LyIF5l3OWo%Jy~NIa|nReCe=fQe:", "uyIF5l3OWoy~NIa|eCe=fQ%vOna{dverfR%]Ona{dverfR", "|yIF5l3OWo%JFG-mFG-mFGy~NIa|nRSMruSMruSMeCe=fQe:fRe:fRe:fR%vOna{oxSLt5SLt5SLdverfRepfRepfRepfR%]Ona{oxSLt5SLt5SLdverfRepfRepfRepfR%vOna{oxSLt5SLt5SLeCe=fQe:fRe:fRe:fR", "eyIF5l3OWo%JFGy~NIa|nRSMeCe=fQe:fR%vOna{oxSLdverfRepfR"},
+		{"00HVB*", "L$HVB*2U$6Sel]a#jtf7gdfjfQfj", "u$HVB*2U$6l]a#jtgdfjfQnQa|jtfjfQfQoLa|jtf6fQfQ", "|$HVB*2U$6Seo1bGa|j[a{l]a#jtf7fQf7fQf7fQgdfjfQfjfQfjfQfjfQnQa|jtfQfQfQfQfQfQfjfQfQfQfQfQfQfQfQoLa|jtfQfQfQfQfQfQf6fQfQfQfQfQfQfQfQoea|jtfQfQfQfQfQfQe:fQfQfQfQfQfQfQfQ", "e$HVB*2U$6Seo1l]a#jtf7fQgdfjfQfjfQnQa|jtfQfQfjfQfQfQfQ"},
+		{"00HV8x", "L%HV8x2U$6Sehla#fQf7gdfQfQfQ", "u%HV8x2U$6hla#fQgdfQfQi|a|fQf%fQfQjHa|fQfjfQfQ", "|%HV8x2U$6Seo2W.jtbGjthla#fQf7fQf7fQf7fQgdfQfQfQfQfQfQfQfQi|a|fQfQfQfQfQfQfQf%fQfQfQfQfQfQfQfQjHa|fQfQfQfQfQfQfQfjfQfQfQfQfQfQfQfQjaa|fQfQfQfQfQfQfQfQfQfQfQfQfQfQfQfQ", "e%HV8x2U$6Seo2hla#fQf7fQgdfQfQfQfQi|a|fQfQfQf%fQfQfQfQ"},
+	},
+	{
+		{"00D-Ki", "LSD-KiyZMe?D_LahIpxZz=vyQ:rG", "uSD-KiyZMe_LahIpz=vyQ:=8beIJnkEAE9.NImMJnkEAE9", "|SD-KiyZMe?DKpK}v@+Cv@_LahIpxZRxP9s0zvs0z=vyQ:rGy0Olm^vWm^=8beIJ-QuaK6S}T]S}nkEAE9#+oaJCOqK@Oq.NImMJzDquM]MNvHMNnkEAE9#+oaJCOqK@Oq=8beIJ-QuaK6S}T]S}z=vyQ:rGy0Olm^vWm^", "eSD-KiyZMe?DKp_LahIpxZRxz=vyQ:rGy0=8beIJ-QuankEAE9#+oa"},
+		{"00HV9x", "L2HV9x}d:$~VUZ9Rmnouu:i[v%Ks", "u2HV9x}d:$UZ9Rmnu:i[v%~D-zK[S=NhIu.9k5RfK9wjKc", "|2HV9x}d:$~VNXp{N4|*sNUZ9RmnourGIuWEEBVau:i[v%Ksi8B+#ETwh~~D-zK[=y;4La-5v;LJS=NhIuqu9uDlw7hR#G.9k5RfikQ;WFJ7QZN1K9wjKc=?z:w]$_jKbe^$ss++,]Mzu[xb:TF.C%vrj=v5Q.5%M#FyBS", "e2HV9x}d:$~VNXUZ9RmnourGu:i[v%Ksi8~D-zK[=y;4S=NhIuqu9u"},
+		{"00HetV", "L0HetV@+.i?w}cVYO@z%9%EUGFTT", "u0HetV@+.i}cVYO@9%EUGFqE$Sp0XcAxoH~qPK+ko9KSOS", "|0HetV@+.i?we-.RwG%h%.}cVYO@z%w7S5Qv*:su9%EUGFTTadnhCIjUStqE$Sp0v#X::9r;W7u1XcAxoHN4XE%Xw6O=K?~qPK+kKJ~1GHLAR=7Mo9KSOSS%BBO9z^nhkf?dBVCNWJoiOWD@Vh#A7X%KtcOjo;y+O~-}y6", "e0HetV@+.i?we-}cVYO@z%w79%EUGFTTadqE$Sp0v#X:XcAxoHN4XE"},
+	},
+	{
+		{"00E.ML", "LcE.ML}nJD77+9$3WYNN5uE,sl#*", "ugE.ML}UJC+SwvWYA2E,slTNS7j?Q]V{j?GdJ;slQ]V{j?", "|gE.ML}UJCBZJCo%JCG0JC+SwvWYNNWYjKWYRqWYA2E,sl#*sla#slwbslTNS7j?oyj?f,j?ofj?Q]V{j?n%j?e;j?n%j?GdJ;slxDslbcslxEslQ]V{j?n%j?e;j?n%j?TNS7j?oyj?f,j?ofj?A2E,sl#*sla#slwbsl", "ecE.ML}nJD77JD+9$3WYNNWY5uE,sl#*slTNS7oJt6oJQ]V{j?n%j?"},
+		{"00E.r8", "LZE.r8]fAd6Vh=f%e;e;3EE-$K$d", "uZE.r8]fAdh=f%e;3EE-$Ki*e;f%S#W=s9jwf7fjs8n~Wr", "|ZE.r8]fAd6VNybINySioIh=f%e;e;f7f7fQf7fj3EE-$K$djsoIw[slWqi*e;f%f%fjfQfjfjf7S#W=s9wusSSOS5a}a}jwf7fjfjfjf7f7f7fQs8n~WrWYfQa}SOWro0kDfjf7f7f7fQf7f7fjr?n~WrSOWro0n~jsjs", "eZE.r8]fAd6VNyh=f%e;e;f73EE-$K$djsi*e;f%f%fjS#W=s9wusS"},
+		{"00FrPU", "LYFrPU|.6B1+hpk9ahaO3EE-$K$K", "uYFrPU|.6Bhpk9ah3EE-$KZ:e;f%K5Sis8aia#j@bHbHjs", "|YFrPU|.6B1+Nya~JVN{oIhpk9ahaOe;fjbGf7fj3EE-$K$Ka}sl$Ksla}Z:e;f%babGjtj?fjf7K5Sis8$1sSSOWYjsWraia#j@k9fjf7jajaa|bHbHjsn$n~WrSPWro0a~a}jsj?j?aza#f7fjs9o0WqWra}fQWqWqo0", "eYFrPU|.6B1+Nyhpk9ahaOe;3EE-$K$Ka}Z:e;f%babGK5Sis8$1sS"},
+	},
+	{
+		{"00HLn3", "LvHLn34ZM*%]%HM~r]gJN[sVa|fP", "uvHLn34ZM*%HM~r]N[sVa|%JRRWEjrSNsUx?a2R-jrSNsU", "|vHLn34ZM*%]IX#=IW%wIW%HM~r]gJWCsCNbxYNbN[sVa|fPo2Woo2Woo2%JRRWEo_WCn+WCoxWCjrSNsUWoa}o0SNsTSNx?a2R-tOWCa#njS|njjrSNsUWoa}o0SNsTSN%JRRWEo_WCn+WCoxWCN[sVa|fPo2Woo2Woo2", "evHLn34ZM*%]IX%HM~r]gJWCN[sVa|fPo2%JRRWEo_WCjrSNsUWoa}"},
+		{"00HVhp", "L5HVhputjoz0%ejXSLjba=WkfKa?", "u6HVhpu@jpx[jXSLa?WlfKx|jRSKWvN^b1-oWRsVb2a[jr", "|6HVhpu@jpu?jpu@a[uqa]x[jXSLjbSKjXSJjbSMa?WlfKfKjpa@a@Wja]x|jRSKn;N,jgN=jTO2WvN^b1N}WsN}WtN|Wt-oWRsVWasPWTsPWTo6b2a[jrjvjpo5a~n|SK%Na%a_avb1jdb1WZn|WnWlWmb0a^o5SJjpWm", "e6HVhpu@jpu?jpx[jXSLjbSKa?WlfKfKjpx|jRSKn;N,WvN^b1N}Ws"},
+		{"00HVhq", "L1HVhqu_fOu_-za$a^a$a^a~a_a~", "u1HVhqu_fO-za$a^a^a~a_%Ua$a^jqa~fO%Ta$a^jpa~jr", "|5HVhqrLfPrLfNrLfPrLfPt2a}a{a}a_a}fOa~fNfOa}fPa}fNa{fPa}fPt1a}a_a}a_a}fOa~fMfOa}fPa}fNa{fQa|fPt0a}a_a}a_a~fOa~fMfOa}fPa~jpa{jsa}fPs}a~a^a~a^a~fNb0fKjpb0fNb1jka_jra~jr", "e1HVhqu_fOu_jo-za$a^a$Wla^a~a_a~fK%Ua$a^a$Wljqa~fOa~jo"},
+	},
+};
+
+struct goldenDecode {
+	const char *hash;
+	int width, height, punch, nChannels;
+	uint64_t checksum; // FNV-1a of the pixels of blurhash_decode_fixed
+};
+
+static const struct goldenDecode goldenDecodes[] = {
+	{"LaJHjmVu8_~po#smR+a~xaoLWCRj", 1, 1, 1, 3, 0xfbd6241ac41f5a04ULL},
+	{"LaJHjmVu8_~po#smR+a~xaoLWCRj", 1, 1, 1, 4, 0x0c3a547b41479881ULL},
+	{"LaJHjmVu8_~po#smR+a~xaoLWCRj", 1, 1, 2, 3, 0xa79dbb1c4744ed4eULL},
+	{"LaJHjmVu8_~po#smR+a~xaoLWCRj", 1, 1, 2, 4, 0x15f2a20d1a1fe3c3ULL},
+	{"LaJHjmVu8_~po#smR+a~xaoLWCRj", 32, 32, 1, 3, 0xec6024b13be9058bULL},
+	{"LaJHjmVu8_~po#smR+a~xaoLWCRj", 32, 32, 1, 4, 0x28aba1bd661668e1ULL},
+	{"LaJHjmVu8_~po#smR+a~xaoLWCRj", 32, 32, 2, 3, 0xac9e39c98f5d12d2ULL},
+	{"LaJHjmVu8_~po#smR+a~xaoLWCRj", 32, 32, 2, 4, 0xda35ce5d96d67cfcULL},
+	{"LaJHjmVu8_~po#smR+a~xaoLWCRj", 160, 120, 1, 3, 0x117f2a15ed1d8fb6ULL},
+	{"LaJHjmVu8_~po#smR+a~xaoLWCRj", 160, 120, 1, 4, 0x19f073542c2cfd0cULL},
+	{"LaJHjmVu8_~po#smR+a~xaoLWCRj", 160, 120, 2, 3, 0x8f0394644cfced1eULL},
+	{"LaJHjmVu8_~po#smR+a~xaoLWCRj", 160, 120, 2, 4, 0xe996da94c85aa256ULL},
+	{"LGFFaXYk^6#M@-5c,1J5@[or[Q6.", 1, 1, 1, 3, 0x9945571a8b5c5ceeULL},
+	{"LGFFaXYk^6#M@-5c,1J5@[or[Q6.", 1, 1, 1, 4, 0xcd2f131acdf070e3ULL},
+	{"LGFFaXYk^6#M@-5c,1J5@[or[Q6.", 1, 1, 2, 3, 0xf4cb881c72c43312ULL},
+	{"LGFFaXYk^6#M@-5c,1J5@[or[Q6.", 1, 1, 2, 4, 0xba0c355703643bb7ULL},
+	{"LGFFaXYk^6#M@-5c,1J5@[or[Q6.", 32, 32, 1, 3, 0x288a437cd79ef9c7ULL},
+	{"LGFFaXYk^6#M@-5c,1J5@[or[Q6.", 32, 32, 1, 4, 0x2592a25f9c979c7bULL},
+	{"LGFFaXYk^6#M@-5c,1J5@[or[Q6.", 32, 32, 2, 3, 0x09ab37c29cb308a0ULL},
+	{"LGFFaXYk^6#M@-5c,1J5@[or[Q6.", 32, 32, 2, 4, 0xafb119c68801c6aaULL},
+	{"LGFFaXYk^6#M@-5c,1J5@[or[Q6.", 160, 120, 1, 3, 0x95945c51bd60d3f1ULL},
+	{"LGFFaXYk^6#M@-5c,1J5@[or[Q6.", 160, 120, 1, 4, 0xc4b633cdcafeeab3ULL},
+	{"LGFFaXYk^6#M@-5c,1J5@[or[Q6.", 160, 120, 2, 3, 0xc6961809886cce61ULL},
+	{"LGFFaXYk^6#M@-5c,1J5@[or[Q6.", 160, 120, 2, 4, 0x983f28c941732357ULL},
+	{"L6PZfSi_.AyE_3t7t7R**0o#DgR4", 1, 1, 1, 3, 0x193e051b65a67d8aULL},
+	{"L6PZfSi_.AyE_3t7t7R**0o#DgR4", 1, 1, 1, 4, 0x8ae0228db9e72dcfULL},
+	{"L6PZfSi_.AyE_3t7t7R**0o#DgR4", 1, 1, 2, 3, 0x655e8c1b90404f03ULL},
+	{"L6PZfSi_.AyE_3t7t7R**0o#DgR4", 1, 1, 2, 4, 0x7ff80ed61d47e934ULL},
+	{"L6PZfSi_.AyE_3t7t7R**0o#DgR4", 32, 32, 1, 3, 0x44fd4ca09a8c1b14ULL},
+	{"L6PZfSi_.AyE_3t7t7R**0o#DgR4", 32, 32, 1, 4, 0xb07dbb2157d45554ULL},
+	{"L6PZfSi_.AyE_3t7t7R**0o#DgR4", 32, 32, 2, 3, 0xd8fd4a26238cf069ULL},
+	{"L6PZfSi_.AyE_3t7t7R**0o#DgR4", 32, 32, 2, 4, 0x1ab388086558c381ULL},
+	{"L6PZfSi_.AyE_3t7t7R**0o#DgR4", 160, 120, 1, 3, 0xe8fa247bde5b07dcULL},
+	{"L6PZfSi_.AyE_3t7t7R**0o#DgR4", 160, 120, 1, 4, 0xc74c71cbbbf5cc9aULL},
+	{"L6PZfSi_.AyE_3t7t7R**0o#DgR4", 160, 120, 2, 3, 0x1abc7735443139a8ULL},
+	{"L6PZfSi_.AyE_3t7t7R**0o#DgR4", 160, 120, 2, 4, 0x0195a85c25f9b1d2ULL},
+	{"00IF5l", 1, 1, 1, 3, 0xeb51791b4ae64ce1ULL},
+	{"00IF5l", 1, 1, 1, 4, 0xc1bce760455356faULL},
+	{"00IF5l", 1, 1, 2, 3, 0xeb51791b4ae64ce1ULL},
+	{"00IF5l", 1, 1, 2, 4, 0xc1bce760455356faULL},
+	{"00IF5l", 32, 32, 1, 3, 0x0090a1a847f53325ULL},
+	{"00IF5l", 32, 32, 1, 4, 0x58b36fa6f5051b25ULL},
+	{"00IF5l", 32, 32, 2, 3, 0x0090a1a847f53325ULL},
+	{"00IF5l", 32, 32, 2, 4, 0x58b36fa6f5051b25ULL},
+	{"00IF5l", 160, 120, 1, 3, 0xe9d86817ef8f8f25ULL},
+	{"00IF5l", 160, 120, 1, 4, 0x7a5bc04e15f1cd25ULL},
+	{"00IF5l", 160, 120, 2, 3, 0xe9d86817ef8f8f25ULL},
+	{"00IF5l", 160, 120, 2, 4, 0x7a5bc04e15f1cd25ULL},
+};
+#define DECODES (sizeof(goldenDecodes) / sizeof(goldenDecodes[0]))
+
+// decodeSizes, punches and decodeHashes span goldenDecodes, for --print
+static const int decodeSizes[][2] = {{1, 1}, {32, 32}, {160, 120}};
+static const char *decodeHashes[] = {"LaJHjmVu8_~po#smR+a~xaoLWCRj", "LGFFaXYk^6#M@-5c,1J5@[or[Q6.", "L6PZfSi_.AyE_3t7t7R**0o#DgR4", "00IF5l"};
+
+static uint64_t fnv1a(const uint8_t *data, size_t size) {
+	uint64_t hash = 14695981039346656037ULL;
+	for(size_t i = 0; i < size; i++) hash = (hash ^ data[i]) * 1099511628211ULL;
+	return hash;
+}
+
+static uint8_t image[200 * 133 * 3], fixedPixels[160 * 120 * 4], floatPixels[160 * 120 * 4];
+
+// fixedSizes: the output sizes at which blurhash_decode_fixed is compared with blurhash_decode
+static const int fixedSizes[][2] = {{32, 32}, {333, 247}, {1920, 1080}};
+
+// checkFixed: blurhash_decode_fixed against blurhash_decode on every hash of goldenHashes, returns the failures
+static int checkFixed(void) {
+	uint8_t *fixed = malloc(1920 * 1080 * 3), *exact = malloc(1920 * 1080 * 3);
+	if(!fixed || !exact) return blurhash_perror(blurhash_error_malloc);
+	int failures = 0;
+	long channels = 0, identical = 0;
+	for(int p = 0; p < PATTERNS; p++) {
+		for(size_t s = 0; s < SIZES; s++) {
+			for(size_t c = 0; c < COMPONENTS; c++) {
+				for(size_t d = 0; d < sizeof(fixedSizes) / sizeof(fixedSizes[0]); d++) {
+					for(int punch = 1; punch <= 2; punch++) {
+						const char *hash = goldenHashes[p][s][c];
+						int width = fixedSizes[d][0], height = fixedSizes[d][1];
+						blurhash_error_t err = blurhash_decode_fixed(hash, width, height, punch, 3, fixed);
+						if(!err) err = blurhash_decode(hash, width, height, punch, 3, exact);
+						int delta = 0;
+						for(size_t k = 0; !err && k < (size_t)width * height * 3; k++) {
+							int channelDelta = abs(fixed[k] - exact[k]);
+							if(channelDelta > delta) delta = channelDelta;
+							if(!channelDelta) identical++;
+							channels++;
+						}
+						if(err || delta > 1) {
+							printf("fixed decode %s %dx%d punch %d: %s, off by %d\n", hash, width, height, punch, err ? blurhash_strerror(err) : "ok", delta);
+							failures++;
+						}
+					}
+				}
+			}
+		}
+	}
+	free(fixed); free(exact);
+	printf("fixed decode: %ld channels, %.2f%% identical to blurhash_decode\n", channels, channels ? 100.0 * identical / channels : 0);
+	return failures;
+}
+
+static void printTables(void) {
+	puts("// goldenHashes");
+	for(int p = 0; p < PATTERNS; p++) {
+		printf("\t{\n");
+		for(size_t s = 0; s < SIZES; s++) {
+			fillImage(p, sizes[s][0], sizes[s][1], image);
+			printf("\t\t{");
+			for(size_t c = 0; c < COMPONENTS; c++) {
+				char hash[BLURHASH_ENCODE_BUFSZ];
+				blurhash_encode(components[c][0], components[c][1], sizes[s][0], sizes[s][1], image, hash);
+				printf("%s\"%s\"", c ? ", " : "", hash);
+			}
+			printf("},\n");
+		}
+		printf("\t},\n");
+	}
+	puts("\n// goldenDecodes");
+	for(size_t h = 0; h < sizeof(decodeHashes) / sizeof(decodeHashes[0]); h++) {
+		for(size_t d = 0; d < sizeof(decodeSizes) / sizeof(decodeSizes[0]); d++) {
+			for(int punch = 1; punch <= 2; punch++) {
+				for(int nChannels = 3; nChannels <= 4; nChannels++) {
+					int width = decodeSizes[d][0], height = decodeSizes[d][1];
+					blurhash_decode_fixed(decodeHashes[h], width, height, punch, nChannels, fixedPixels);
+					printf("\t{\"%s\", %d, %d, %d, %d, 0x%016llxULL},\n", decodeHashes[h], width, height, punch, nChannels,
+						(unsigned long long)fnv1a(fixedPixels, (size_t)width * height * nChannels));
+				}
+			}
+		}
+	}
+}
+
+int main(int argc, const char **argv) {
+	if(argc == 2 && !strcmp(argv[1], "--print")) {
+		printTables();
+		return 0;
+	}
+
+	int failures = 0;
+	for(int p = 0; p < PATTERNS; p++) {
+		for(size_t s = 0; s < SIZES; s++) {
+			fillImage(p, sizes[s][0], sizes[s][1], image);
+			for(size_t c = 0; c < COMPONENTS; c++) {
+				for(size_t e = 0; e < ENGINES; e++) {
+					char hash[BLURHASH_ENCODE_BUFSZ];
+					blurhash_error_t err = encodeEngines[e].encode(components[c][0], components[c][1], sizes[s][0], sizes[s][1], image, hash);
+					if(err || strcmp(hash, goldenHashes[p][s][c])) {
+						printf("%s pattern %d %dx%d %dx%d: %s, expected %s\n", encodeEngines[e].name, p, sizes[s][0], sizes[s][1],
+							components[c][0], components[c][1], err ? blurhash_strerror(err) : hash, goldenHashes[p][s][c]);
+						failures++;
+					}
+				}
+			}
+		}
+	}
+	blurhash_ctx_free(ctx);
+
+	for(size_t d = 0; d < DECODES; d++) {
+		const struct goldenDecode *g = &goldenDecodes[d];
+		size_t size = (size_t)g->width * g->height * g->nChannels;
+		blurhash_error_t err = blurhash_decode_fixed(g->hash, g->width, g->height, g->punch, g->nChannels, fixedPixels);
+		if(!err) err = blurhash_decode(g->hash, g->width, g->height, g->punch, g->nChannels, floatPixels);
+		int delta = 0;
+		for(size_t k = 0; !err && k < size; k++) {
+			int channelDelta = abs(fixedPixels[k] - floatPixels[k]);
+			if(channelDelta > delta) delta = channelDelta;
+		}
+		uint64_t checksum = fnv1a(fixedPixels, size);
+		if(err || checksum != g->checksum || delta > 1) {
+			printf("decode %s %dx%d punch %d channels %d: %s, checksum %016llx, expected %016llx, float decode off by %d\n",
+				g->hash, g->width, g->height, g->punch, g->nChannels, err ? blurhash_strerror(err) : "ok",
+				(unsigned long long)checksum, (unsigned long long)g->checksum, delta);
+			failures++;
+		}
+	}
+
+	failures += checkFixed();
+
+	printf("%zu encodes, %zu decodes, %d failures\n", (size_t)PATTERNS * SIZES * COMPONENTS, DECODES, failures);
+	return failures ? 1 : 0;
+}
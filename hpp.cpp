@@ -0,0 +1,133 @@
+/* hpp.cpp
+ * This file is part of the blurhash distribution (https://github.com/fumiama/blurhash).
+ * Copyright (c) 2018 Wolt Enterprises and Copyright (c) 2025 Fumiama Minamoto.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+// blurhash_hpp: runs blurhash::encode and blurhash::decode of blurhash.hpp for all 81 component counts against
+// blurhash_encode and blurhash_decode, run by ctest. The header promises results within one quantisation step
+// of every hash digit and one 8-bit level of every pixel; any difference beyond that is printed and fails the test.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "blurhash.hpp"
+
+static const char base83[] = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz#$%*+,-.:;=?@[]^_{|}~";
+
+static int decodeInt(const char *s, int length) {
+	int value = 0;
+	for(int i = 0; i < length; i++) value = value * 83 + (int)(strchr(base83, s[i]) - base83);
+	return value;
+}
+
+// hashDelta: the largest difference of the size flag, maximum, DC channels and AC quantisations of two hashes,
+// 100 if they differ in length or size flag
+static int hashDelta(const char *a, const char *b) {
+	size_t length = strlen(a);
+	if(length != strlen(b) || a[0] != b[0]) return 100;
+	int delta = abs(decodeInt(a + 1, 1) - decodeInt(b + 1, 1));
+	int dcA = decodeInt(a + 2, 4), dcB = decodeInt(b + 2, 4);
+	for(int shift = 0; shift <= 16; shift += 8) {
+		int channelDelta = abs((dcA >> shift & 255) - (dcB >> shift & 255));
+		if(channelDelta > delta) delta = channelDelta;
+	}
+	for(size_t k = 6; k < length; k += 2) {
+		int acA = decodeInt(a + k, 2), acB = decodeInt(b + k, 2);
+		int quantDelta[3] = {abs(acA / 361 - acB / 361), abs(acA / 19 % 19 - acB / 19 % 19), abs(acA % 19 - acB % 19)};
+		for(int c = 0; c < 3; c++) {
+			if(quantDelta[c] > delta) delta = quantDelta[c];
+		}
+	}
+	return delta;
+}
+
+// fillImage: smooth gradients under a disc, so that every component has some energy
+static void fillImage(int width, int height, std::vector<uint8_t> &rgb) {
+	rgb.resize((size_t)width * height * 3);
+	for(int y = 0; y < height; y++) {
+		for(int x = 0; x < width; x++) {
+			uint8_t *px = &rgb[((size_t)y * width + x) * 3];
+			int dx = x - width / 3, dy = y - height / 2;
+			px[0] = x * 255 / (width - 1);
+			px[1] = dx * dx + dy * dy < width * width / 16 ? 230 : y * 200 / (height - 1);
+			px[2] = (x * 37 + y * 11) % 256;
+		}
+	}
+}
+
+int main() {
+	const int width = 67, height = 43, decodeWidth = 45, decodeHeight = 31;
+	std::vector<uint8_t> rgb, rgba((size_t)(width * 4 + 12) * height);
+	fillImage(width, height, rgb);
+	for(int y = 0; y < height; y++) {
+		for(int x = 0; x < width; x++) {
+			memcpy(&rgba[(size_t)y * (width * 4 + 12) + x * 4], &rgb[((size_t)y * width + x) * 3], 3);
+			rgba[(size_t)y * (width * 4 + 12) + x * 4 + 3] = 255;
+		}
+	}
+
+	int failures = 0, worstHash = 0, worstPixel = 0;
+	std::vector<uint8_t> expected((size_t)decodeWidth * decodeHeight * 4), got(expected.size());
+	for(int yC = 1; yC <= 9; yC++) {
+		for(int xC = 1; xC <= 9; xC++) {
+			char hash[BLURHASH_ENCODE_BUFSZ];
+			blurhash_error_t err = blurhash_encode(xC, yC, width, height, rgb.data(), hash);
+			blurhash::result<blurhash::any_hash_t> packed = blurhash::encode(xC, yC, {rgb, width, height, (size_t)width * 3, 3});
+			blurhash::result<blurhash::any_hash_t> strided = blurhash::encode(xC, yC, {rgba, width, height, (size_t)width * 4 + 12, 4});
+			int delta = err || !packed || !strided ? 100 : hashDelta(hash, packed.value.data());
+			if(!err && strided && strcmp(packed.value.data(), strided.value.data())) delta = 100;
+			if(delta > worstHash) worstHash = delta;
+			if(delta > 1) {
+				printf("encode %dx%d: %s, blurhash_encode %s\n", xC, yC, packed.value.data(), err ? blurhash_strerror(err) : hash);
+				failures++;
+				continue;
+			}
+
+			for(int punch = 1; punch <= 2; punch++) {
+				err = blurhash_decode(hash, decodeWidth, decodeHeight, punch, 4, expected.data());
+				blurhash_error_t hppErr = blurhash::decode(hash, {got, decodeWidth, decodeHeight, (size_t)decodeWidth * 4, 4}, punch);
+				delta = err || hppErr ? 256 : 0;
+				for(size_t k = 0; !delta && k < got.size(); k++) {
+					int channelDelta = abs(got[k] - expected[k]);
+					if(channelDelta > worstPixel) worstPixel = channelDelta;
+					if(channelDelta > 1) delta = channelDelta;
+				}
+				if(delta) {
+					printf("decode %s punch %d: off by %d\n", hash, punch, delta);
+					failures++;
+				}
+			}
+		}
+	}
+
+	// a DC of valid digits above 0xFFFFFF saturates its red instead of reading past the conversion table
+	blurhash_error_t err = blurhash_decode("0~~~~~", 2, 2, 1, 4, expected.data());
+	blurhash_error_t hppErr = blurhash::decode("0~~~~~", {got, 2, 2, 2 * 4, 4});
+	if(err || hppErr || memcmp(got.data(), expected.data(), 2 * 2 * 4)) {
+		printf("decode 0~~~~~: %d %d %d, blurhash_decode %d %d %d\n", got[0], got[1], got[2], expected[0], expected[1], expected[2]);
+		failures++;
+	}
+
+	printf("81 component counts, largest hash digit difference %d, largest pixel difference %d, %d failures\n", worstHash, worstPixel, failures);
+	return failures ? 1 : 0;
+}
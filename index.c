@@ -0,0 +1,342 @@
+/* index.c
+ * This file is part of the blurhash distribution (https://github.com/fumiama/blurhash).
+ * Copyright (c) 2018 Wolt Enterprises and Copyright (c) 2025 Fumiama Minamoto.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "blurhash.h"
+#include "common.h"
+
+// The index file is a 64-byte header followed by one 64-byte node per hash, in host byte order.
+// The nodes [lo, hi) form a subtree: up to INDEX_LEAF nodes are a bucket scanned as a whole, otherwise node lo
+// is the vantage point, the nodes [lo + 1, mid) are at most mu from it and the nodes [mid, hi) at least mu,
+// with mid = lo + 1 + (hi - lo - 1) / 2. The shape follows from the count, so no child links are stored.
+
+#define INDEX_MAGIC "BLURIDX1"
+// INDEX_LEAF is the largest subtree scanned as a bucket, by the distance kernel over the whole bucket
+#define INDEX_LEAF 32
+
+typedef struct indexHeader {
+	char magic[8];
+	uint32_t dims;
+	uint32_t leaf; // INDEX_LEAF of the build, the tree shape depends on it
+	uint64_t count;
+	uint8_t reserved[40];
+} indexHeader;
+
+typedef struct indexNode {
+	int8_t feature[BLURHASH_FEATURE_DIMS];
+	uint64_t id;
+	float mu; // median distance of the subtree of a vantage point
+	uint32_t scratch; // squared distance to the vantage point of the subtree being built
+} indexNode;
+
+_Static_assert(sizeof(indexHeader) == 64 && sizeof(indexNode) == 64, "index records must be 64 bytes");
+
+struct blurhash_index_t {
+	const indexNode *nodes;
+	uint64_t count;
+	void *map;
+	size_t size;
+};
+
+struct blurhash_index_writer_t {
+	FILE *fp;
+	uint64_t count;
+};
+
+blurhash_error_t blurhash_feature(const char * blurhash, int8_t *feature) {
+	blurhash_coeffs_t coeffs;
+	blurhash_error_t err = blurhash_parse(blurhash, 1, &coeffs);
+	if(err) return err;
+
+	memset(feature, 0, BLURHASH_FEATURE_DIMS);
+	for(int j = 0; j < 4 && j < coeffs.numY; j++) {
+		for(int i = 0; i < 4 && i < coeffs.numX; i++) {
+			for(int c = 0; c < 3; c++) {
+				float v = coeffs.colors[i + j * coeffs.numX][c] * 254 - (i == 0 && j == 0 ? 127 : 0);
+				feature[(j * 4 + i) * 3 + c] = fmaxf(-127, fminf(127, roundf(v)));
+			}
+		}
+	}
+	return blurhash_error_ok;
+}
+
+blurhash_error_t blurhash_index_writer_begin(blurhash_index_writer_t **writer, const char *filename) {
+	blurhash_index_writer_t *w = malloc(sizeof(blurhash_index_writer_t));
+	if(!w) return blurhash_error_malloc;
+	w->fp = fopen(filename, "w+b");
+	w->count = 0;
+	indexHeader header = {0};
+	if(!w->fp || fwrite(&header, sizeof(header), 1, w->fp) != 1) {
+		if(w->fp) fclose(w->fp);
+		free(w);
+		return blurhash_error_write;
+	}
+	*writer = w;
+	return blurhash_error_ok;
+}
+
+blurhash_error_t blurhash_index_writer_add(blurhash_index_writer_t *writer, const char * blurhash, uint64_t id) {
+	indexNode node = {.id = id};
+	blurhash_error_t err = blurhash_feature(blurhash, node.feature);
+	if(err) return err;
+	if(fwrite(&node, sizeof(node), 1, writer->fp) != 1) return blurhash_error_write;
+	writer->count++;
+	return blurhash_error_ok;
+}
+
+void blurhash_index_writer_free(blurhash_index_writer_t *writer) {
+	fclose(writer->fp);
+	free(writer);
+}
+
+// selectNodes: reorders nodes[0, n) by scratch so that nodes[k] is the k-th smallest,
+// with no larger one before it and no smaller one after it
+static void selectNodes(indexNode *nodes, ptrdiff_t n, ptrdiff_t k) {
+	ptrdiff_t l = 0, r = n - 1;
+	while(l < r) {
+		uint32_t pivot = nodes[k].scratch;
+		ptrdiff_t i = l, j = r;
+		do {
+			while(nodes[i].scratch < pivot) i++;
+			while(pivot < nodes[j].scratch) j--;
+			if(i <= j) {
+				indexNode t = nodes[i];
+				nodes[i++] = nodes[j];
+				nodes[j--] = t;
+			}
+		} while(i <= j);
+		if(j < k) l = i;
+		if(k < i) r = j;
+	}
+}
+
+// buildTask: the subtree [lo, hi) of buildTree, spawning threads for the subtrees of the top spawn levels
+struct buildTask {
+	indexNode *nodes;
+	size_t lo, hi;
+	int spawn;
+};
+
+static void *buildTree(void *arg) {
+	struct buildTask *task = arg;
+	indexNode *nodes = task->nodes;
+	size_t lo = task->lo, hi = task->hi;
+	if(hi - lo <= INDEX_LEAF) return NULL;
+
+	// a pseudo-random vantage point, the same for the same file
+	uint64_t seed = (lo + 1) * 0x9e3779b97f4a7c15ull;
+	size_t pick = lo + (seed ^ (seed >> 29)) % (hi - lo);
+	indexNode t = nodes[lo];
+	nodes[lo] = nodes[pick];
+	nodes[pick] = t;
+
+	size_t n = hi - lo - 1, mid = lo + 1 + n / 2;
+	uint32_t distance[INDEX_LEAF];
+	for(size_t k = 0; k < n; k += INDEX_LEAF) {
+		int batch = n - k < INDEX_LEAF ? n - k : INDEX_LEAF;
+		blurhash_kernel_feature_distances(nodes[lo].feature, (const uint8_t *)(nodes + lo + 1 + k), sizeof(indexNode), batch, distance);
+		for(int b = 0; b < batch; b++) nodes[lo + 1 + k + b].scratch = distance[b];
+	}
+	selectNodes(nodes + lo + 1, n, n / 2);
+	nodes[lo].mu = sqrtf(nodes[mid].scratch);
+
+	struct buildTask inside = {nodes, lo + 1, mid, task->spawn - 1};
+	pthread_t thread;
+	bool spawned = task->spawn > 0 && !pthread_create(&thread, NULL, buildTree, &inside);
+	if(!spawned) buildTree(&inside);
+	struct buildTask outside = {nodes, mid, hi, task->spawn - 1};
+	buildTree(&outside);
+	if(spawned) pthread_join(thread, NULL);
+	return NULL;
+}
+
+blurhash_error_t blurhash_index_writer_finish(blurhash_index_writer_t *writer, int nthreads) {
+	blurhash_error_t err = blurhash_error_ok;
+	size_t size = sizeof(indexHeader) + writer->count * sizeof(indexNode);
+	void *map = MAP_FAILED;
+	if(fflush(writer->fp) || (map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fileno(writer->fp), 0)) == MAP_FAILED) {
+		err = blurhash_error_write;
+		goto done;
+	}
+
+	if(nthreads <= 0) nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+	int spawn = 0;
+	while((1 << spawn) < nthreads) spawn++;
+	struct buildTask root = {(indexNode *)((uint8_t *)map + sizeof(indexHeader)), 0, writer->count, spawn};
+	buildTree(&root);
+
+	indexHeader header = {.dims = BLURHASH_FEATURE_DIMS, .leaf = INDEX_LEAF, .count = writer->count};
+	memcpy(header.magic, INDEX_MAGIC, sizeof(header.magic));
+	memcpy(map, &header, sizeof(header));
+	if(munmap(map, size)) err = blurhash_error_write;
+
+done:
+	if(fclose(writer->fp) && !err) err = blurhash_error_write;
+	free(writer);
+	return err;
+}
+
+blurhash_error_t blurhash_index_open(blurhash_index_t **index, const char *filename) {
+	int fd = open(filename, O_RDONLY);
+	if(fd < 0) return blurhash_error_invalid_index;
+	struct stat st;
+	void *map = MAP_FAILED;
+	if(!fstat(fd, &st) && (size_t)st.st_size >= sizeof(indexHeader)) {
+		map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	}
+	close(fd);
+	if(map == MAP_FAILED) return blurhash_error_invalid_index;
+
+	const indexHeader *header = map;
+	if(memcmp(header->magic, INDEX_MAGIC, sizeof(header->magic)) || header->dims != BLURHASH_FEATURE_DIMS || header->leaf != INDEX_LEAF
+		|| header->count != (st.st_size - sizeof(indexHeader)) / sizeof(indexNode)) {
+		munmap(map, st.st_size);
+		errno = EINVAL;
+		return blurhash_error_invalid_index;
+	}
+
+	blurhash_index_t *idx = malloc(sizeof(blurhash_index_t));
+	if(!idx) {
+		munmap(map, st.st_size);
+		return blurhash_error_malloc;
+	}
+	// queries jump around the file, read-ahead would mostly fetch pages that are never looked at
+	madvise(map, st.st_size, MADV_RANDOM);
+	idx->nodes = (const indexNode *)((const uint8_t *)map + sizeof(indexHeader));
+	idx->count = header->count;
+	idx->map = map;
+	idx->size = st.st_size;
+	*index = idx;
+	return blurhash_error_ok;
+}
+
+void blurhash_index_close(blurhash_index_t *index) {
+	if(!index) return;
+	munmap(index->map, index->size);
+	free(index);
+}
+
+uint64_t blurhash_index_size(const blurhash_index_t *index) {
+	return index->count;
+}
+
+// indexSearch: a k-NN query when k > 0, keeping matches as a max-heap of distance,
+// else a radius query appending to matches
+struct indexSearch {
+	const blurhash_index_t *index;
+	const int8_t *query;
+	size_t k, capacity, count;
+	float tau; // the largest distance still of interest
+	blurhash_match_t *matches;
+};
+
+static void siftDown(blurhash_match_t *heap, size_t n, size_t i) {
+	for(;;) {
+		size_t largest = i, l = 2 * i + 1, r = l + 1;
+		if(l < n && heap[l].distance > heap[largest].distance) largest = l;
+		if(r < n && heap[r].distance > heap[largest].distance) largest = r;
+		if(largest == i) return;
+		blurhash_match_t t = heap[i];
+		heap[i] = heap[largest];
+		heap[largest] = t;
+		i = largest;
+	}
+}
+
+static void offerMatch(struct indexSearch *search, uint64_t id, float distance) {
+	if(distance > search->tau) return;
+	if(!search->k) {
+		if(search->count < search->capacity) search->matches[search->count] = (blurhash_match_t){id, distance};
+		search->count++;
+		return;
+	}
+	blurhash_match_t *heap = search->matches;
+	if(search->count < search->k) {
+		size_t i = search->count++;
+		heap[i] = (blurhash_match_t){id, distance};
+		while(i > 0 && heap[(i - 1) / 2].distance < heap[i].distance) {
+			blurhash_match_t t = heap[i];
+			heap[i] = heap[(i - 1) / 2];
+			heap[(i - 1) / 2] = t;
+			i = (i - 1) / 2;
+		}
+	} else {
+		heap[0] = (blurhash_match_t){id, distance};
+		siftDown(heap, search->count, 0);
+	}
+	if(search->count == search->k) search->tau = heap[0].distance;
+}
+
+static void searchTree(struct indexSearch *search, uint64_t lo, uint64_t hi) {
+	const indexNode *nodes = search->index->nodes;
+	if(hi - lo <= INDEX_LEAF) {
+		uint32_t distance[INDEX_LEAF];
+		for(uint64_t k = lo; k < hi; k += INDEX_LEAF) {
+			int batch = hi - k < INDEX_LEAF ? hi - k : INDEX_LEAF;
+			blurhash_kernel_feature_distances(search->query, (const uint8_t *)(nodes + k), sizeof(indexNode), batch, distance);
+			for(int b = 0; b < batch; b++) offerMatch(search, nodes[k + b].id, sqrtf(distance[b]));
+		}
+		return;
+	}
+
+	uint32_t d2;
+	blurhash_kernel_feature_distances(search->query, (const uint8_t *)(nodes + lo), sizeof(indexNode), 1, &d2);
+	float d = sqrtf(d2), mu = nodes[lo].mu;
+	offerMatch(search, nodes[lo].id, d);
+
+	// the side holding the query first, as it is the likelier to shrink tau
+	uint64_t mid = lo + 1 + (hi - lo - 1) / 2;
+	if(d < mu) {
+		if(d - search->tau <= mu) searchTree(search, lo + 1, mid);
+		if(d + search->tau >= mu) searchTree(search, mid, hi);
+	} else {
+		if(d + search->tau >= mu) searchTree(search, mid, hi);
+		if(d - search->tau <= mu) searchTree(search, lo + 1, mid);
+	}
+}
+
+static int compareMatches(const void *a, const void *b) {
+	float x = ((const blurhash_match_t *)a)->distance, y = ((const blurhash_match_t *)b)->distance;
+	return (x > y) - (x < y);
+}
+
+blurhash_error_t blurhash_index_knn(const blurhash_index_t *index, const int8_t *feature, size_t k, blurhash_match_t *matches, size_t *count) {
+	struct indexSearch search = {index, feature, k, 0, 0, INFINITY, matches};
+	if(k && index->count) searchTree(&search, 0, index->count);
+	qsort(matches, search.count, sizeof(blurhash_match_t), compareMatches);
+	*count = search.count;
+	return blurhash_error_ok;
+}
+
+blurhash_error_t blurhash_index_radius(const blurhash_index_t *index, const int8_t *feature, float radius, blurhash_match_t *matches, size_t capacity, size_t *count) {
+	struct indexSearch search = {index, feature, 0, capacity, 0, radius, matches};
+	if(index->count) searchTree(&search, 0, index->count);
+	*count = search.count;
+	return blurhash_error_ok;
+}
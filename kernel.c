@@ -0,0 +1,197 @@
+/* kernel.c
+ * This file is part of the blurhash distribution (https://github.com/fumiama/blurhash).
+ * Copyright (c) 2018 Wolt Enterprises and Copyright (c) 2025 Fumiama Minamoto.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "blurhash.h"
+#include "common.h"
+
+// The kernels below are written as plain loops over planar float rows so that
+// every BLURHASH_DISPATCH clone is auto-vectorised for its own instruction set.
+// All clones evaluate the same sums, only the summation order differs, so their
+// results match the scalar path within float rounding.
+
+#define linearise_row_loop(type, step, ri, gi, bi, convert) \
+	for(int x = 0; x < width; x++) { \
+		const type *px = (const type *)row + (step) * x; \
+		r[x] = convert(px[ri]); \
+		g[x] = convert(px[gi]); \
+		b[x] = convert(px[bi]); \
+	}
+
+BLURHASH_DISPATCH
+void blurhash_kernel_linearise_row(const uint8_t *row, blurhash_format_t format, int width, float *r, float *g, float *b) {
+	// one specialised loop per format, so that the layout is known inside each of them
+	switch(format) {
+		case blurhash_format_rgb8: linearise_row_loop(uint8_t, 3, 0, 1, 2, blurhash_sRGBToLinear); break;
+		case blurhash_format_rgba8: linearise_row_loop(uint8_t, 4, 0, 1, 2, blurhash_sRGBToLinear); break;
+		case blurhash_format_bgr8: linearise_row_loop(uint8_t, 3, 2, 1, 0, blurhash_sRGBToLinear); break;
+		case blurhash_format_bgra8: linearise_row_loop(uint8_t, 4, 2, 1, 0, blurhash_sRGBToLinear); break;
+		case blurhash_format_gray8: linearise_row_loop(uint8_t, 1, 0, 0, 0, blurhash_sRGBToLinear); break;
+		case blurhash_format_rgb16: linearise_row_loop(uint16_t, 3, 0, 1, 2, blurhash_sRGB16ToLinear); break;
+		case blurhash_format_rgba16: linearise_row_loop(uint16_t, 4, 0, 1, 2, blurhash_sRGB16ToLinear); break;
+		case blurhash_format_gray16: linearise_row_loop(uint16_t, 1, 0, 0, 0, blurhash_sRGB16ToLinear); break;
+	}
+}
+
+#undef linearise_row_loop
+
+BLURHASH_DISPATCH
+void blurhash_kernel_row_sums(const float *basis, int components, int width, const float *r, const float *g, const float *b, float *sums) {
+	for(int i = 0; i < components; i++) {
+		const float *cosX = basis + i * width;
+		float sr = 0, sg = 0, sb = 0;
+		for(int x = 0; x < width; x++) {
+			sr += cosX[x] * r[x];
+			sg += cosX[x] * g[x];
+			sb += cosX[x] * b[x];
+		}
+		sums[i * 3 + 0] = sr;
+		sums[i * 3 + 1] = sg;
+		sums[i * 3 + 2] = sb;
+	}
+}
+
+BLURHASH_DISPATCH
+void blurhash_kernel_add_basis(const float *basis, float cr, float cg, float cb, int width, float *r, float *g, float *b) {
+	for(int x = 0; x < width; x++) {
+		r[x] += cr * basis[x];
+		g[x] += cg * basis[x];
+		b[x] += cb * basis[x];
+	}
+}
+
+BLURHASH_DISPATCH
+void blurhash_kernel_feature_distances(const int8_t *query, const uint8_t *vectors, size_t stride, int n, uint32_t *out) {
+	for(int k = 0; k < n; k++) {
+		const int8_t *v = (const int8_t *)(vectors + k * stride);
+		int32_t sum = 0;
+		for(int d = 0; d < BLURHASH_FEATURE_DIMS; d++) {
+			int32_t diff = query[d] - v[d];
+			sum += diff * diff;
+		}
+		out[k] = sum;
+	}
+}
+
+// base83Vector: 16 characters, checked together through the generic vector extension of GCC and Clang
+typedef uint8_t base83Vector __attribute__((vector_size(16)));
+
+// base83Lanes: all-ones in the lanes of c that are in blurhash_base83_table, the disjoint ranges
+// # ~ %, * ~ ; but /, =, ? ~ [, ] ~ _ and a ~ ~
+static inline base83Vector base83Lanes(base83Vector c) {
+	return (base83Vector)((c - '#' <= '%' - '#') | ((c - '*' <= ';' - '*') & (c != '/')) | (c == '=')
+		| (c - '?' <= '[' - '?') | (c - ']' <= '_' - ']') | (c - 'a' <= '~' - 'a'));
+}
+
+BLURHASH_DISPATCH
+bool blurhash_kernel_base83_check(const char *s, int length) {
+	base83Vector all, c;
+	memset(&all, 0xff, sizeof(all));
+	// whole vectors, the last one overlapping the one before it instead of a scalar remainder
+	for(int i = 0; i < length; i += sizeof(c)) {
+		memcpy(&c, s + (i + (int)sizeof(c) <= length ? i : length - (int)sizeof(c)), sizeof(c));
+		all &= base83Lanes(c);
+	}
+	uint64_t halves[2];
+	memcpy(halves, &all, sizeof(halves));
+	return (halves[0] & halves[1]) == UINT64_MAX;
+}
+
+BLURHASH_DISPATCH
+void blurhash_kernel_store_row(const float *r, const float *g, const float *b, int width, int nChannels, uint8_t *out) {
+	if(nChannels == 4) {
+		for(int x = 0; x < width; x++) {
+			out[4 * x + 0] = blurhash_linearTosRGB(r[x]);
+			out[4 * x + 1] = blurhash_linearTosRGB(g[x]);
+			out[4 * x + 2] = blurhash_linearTosRGB(b[x]);
+			out[4 * x + 3] = 255;   // treat each pixel as RGBA instead of RGB
+		}
+	} else {
+		for(int x = 0; x < width; x++) {
+			out[nChannels * x + 0] = blurhash_linearTosRGB(r[x]);
+			out[nChannels * x + 1] = blurhash_linearTosRGB(g[x]);
+			out[nChannels * x + 2] = blurhash_linearTosRGB(b[x]);
+		}
+	}
+}
+
+BLURHASH_DISPATCH
+void blurhash_kernel_add_basis_fixed(const int32_t *basis, int32_t cr, int32_t cg, int32_t cb, int width, int32_t *r, int32_t *g, int32_t *b) {
+	for(int x = 0; x < width; x++) {
+		r[x] += (cr * basis[x] + (1 << 11)) >> 12;
+		g[x] += (cg * basis[x] + (1 << 11)) >> 12;
+		b[x] += (cb * basis[x] + (1 << 11)) >> 12;
+	}
+}
+
+// storeFixed: the sRGB value of a Q17 linear value, rounded to Q15 and clamped to [0, 1]
+static inline uint8_t storeFixed(int32_t value) {
+	value = (value + 2) >> 2;
+	value = value < 0 ? 0 : value > BLURHASH_Q15_ONE ? BLURHASH_Q15_ONE : value;
+	return blurhash_linearQ15TosRGB_table[value];
+}
+
+BLURHASH_DISPATCH
+void blurhash_kernel_store_row_fixed(const int32_t *r, const int32_t *g, const int32_t *b, int width, int nChannels, uint8_t *out) {
+	if(nChannels == 4) {
+		for(int x = 0; x < width; x++) {
+			out[4 * x + 0] = storeFixed(r[x]);
+			out[4 * x + 1] = storeFixed(g[x]);
+			out[4 * x + 2] = storeFixed(b[x]);
+			out[4 * x + 3] = 255;
+		}
+	} else {
+		for(int x = 0; x < width; x++) {
+			out[nChannels * x + 0] = storeFixed(r[x]);
+			out[nChannels * x + 1] = storeFixed(g[x]);
+			out[nChannels * x + 2] = storeFixed(b[x]);
+		}
+	}
+}
+
+BLURHASH_DISPATCH
+void blurhash_kernel_resample_row(const float *src, const int *runStart, int samples, const float *weight, float *dst) {
+	for(int k = 0; k < samples; k++) {
+		float lo = src[k], delta = src[k + 1] - src[k];
+		for(int x = runStart[k]; x < runStart[k + 1]; x++) {
+			dst[x] = lo + weight[x] * delta;
+		}
+	}
+}
+
+BLURHASH_DISPATCH
+void blurhash_kernel_pack_row(const float *r, const float *g, const float *b, int width, int nChannels, uint8_t *out) {
+	if(nChannels == 4) {
+		for(int x = 0; x < width; x++) {
+			out[4 * x + 0] = (int)(r[x] + 0.5f);
+			out[4 * x + 1] = (int)(g[x] + 0.5f);
+			out[4 * x + 2] = (int)(b[x] + 0.5f);
+			out[4 * x + 3] = 255;
+		}
+	} else {
+		for(int x = 0; x < width; x++) {
+			out[nChannels * x + 0] = (int)(r[x] + 0.5f);
+			out[nChannels * x + 1] = (int)(g[x] + 0.5f);
+			out[nChannels * x + 2] = (int)(b[x] + 0.5f);
+		}
+	}
+}
@@ -0,0 +1,354 @@
+/* output.c
+ * This file is part of the blurhash distribution (https://github.com/fumiama/blurhash).
+ * Copyright (c) 2018 Wolt Enterprises and Copyright (c) 2025 Fumiama Minamoto.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stb/stb_image_write.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "blurhash.h"
+#include "common.h"
+
+// BAND_BYTES is the size of the pixels rendered and written at a time
+#define BAND_BYTES (64 * 1024)
+// STORED_BLOCK is the largest stored deflate block
+#define STORED_BLOCK 65535
+
+// crcTable: the CRC-32 of PNG chunks, filled at load time
+static uint32_t crcTable[256];
+
+static void __attribute__((constructor)) fillCrcTable(void) {
+	for(uint32_t n = 0; n < 256; n++) {
+		uint32_t c = n;
+		for(int k = 0; k < 8; k++) c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+		crcTable[n] = c;
+	}
+}
+
+static uint32_t crc32(uint32_t crc, const uint8_t *data, size_t n) {
+	crc = ~crc;
+	for(size_t i = 0; i < n; i++) crc = crcTable[(crc ^ data[i]) & 255] ^ (crc >> 8);
+	return ~crc;
+}
+
+static uint32_t adler32(uint32_t adler, const uint8_t *data, size_t n) {
+	uint32_t a = adler & 0xffff, b = adler >> 16;
+	while(n) {
+		// 5552 bytes is the most that cannot overflow b before the modulo
+		size_t block = n < 5552 ? n : 5552;
+		for(size_t i = 0; i < block; i++) {
+			a += data[i];
+			b += a;
+		}
+		a %= 65521;
+		b %= 65521;
+		data += block;
+		n -= block;
+	}
+	return b << 16 | a;
+}
+
+static inline uint8_t *putBE32(uint8_t *p, uint32_t v) {
+	p[0] = v >> 24; p[1] = v >> 16; p[2] = v >> 8; p[3] = v;
+	return p + 4;
+}
+
+// writeAll: writes n bytes to fd, retrying short and interrupted writes
+static blurhash_error_t writeAll(int fd, const void *data, size_t n) {
+	const uint8_t *p = data;
+	while(n) {
+		ssize_t written = write(fd, p, n);
+		if(written < 0) {
+			if(errno == EINTR) continue;
+			return blurhash_error_write;
+		}
+		p += written;
+		n -= written;
+	}
+	return blurhash_error_ok;
+}
+
+// pngChunk: completes the PNG chunk of type whose n data bytes are already at chunk + 8, returning its end
+static uint8_t *pngChunk(uint8_t *chunk, const char *type, size_t n) {
+	putBE32(chunk, (uint32_t)n);
+	memcpy(chunk + 4, type, 4);
+	return putBE32(chunk + 8 + n, crc32(0, chunk + 4, 4 + n));
+}
+
+// outputStream: state of one image being streamed by blurhash_decode_fd
+struct outputStream {
+	int fd;
+	blurhash_file_format_t format;
+	int width, nChannels;
+	uint8_t *out; // encoded bytes of one band
+	// png
+	uint32_t adler;
+	bool first;
+	// qoi
+	uint8_t index[64][4], previous[4];
+	int run;
+	uint64_t pixelsLeft;
+};
+
+// writeHeader: writes everything of the file before the first pixel
+static blurhash_error_t writeHeader(struct outputStream *stream, int height) {
+	uint8_t header[128], *p = header;
+	switch(stream->format) {
+		case blurhash_file_format_png: {
+			static const uint8_t signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+			memcpy(p, signature, 8);
+			uint8_t *ihdr = p + 16;
+			putBE32(putBE32(ihdr, stream->width), height);
+			ihdr[8] = 8; // bits per channel
+			ihdr[9] = stream->nChannels == 4 ? 6 : 2; // RGBA or RGB
+			ihdr[10] = ihdr[11] = ihdr[12] = 0; // deflate, adaptive filters, not interlaced
+			p = pngChunk(p + 8, "IHDR", 13);
+		}
+		break;
+		case blurhash_file_format_ppm:
+			p += sprintf((char *)p, "P6\n%d %d\n255\n", stream->width, height);
+		break;
+		case blurhash_file_format_pam:
+			p += sprintf((char *)p, "P7\nWIDTH %d\nHEIGHT %d\nDEPTH %d\nMAXVAL 255\nTUPLTYPE %s\nENDHDR\n",
+				stream->width, height, stream->nChannels, stream->nChannels == 4 ? "RGB_ALPHA" : "RGB");
+		break;
+		case blurhash_file_format_qoi:
+			memcpy(p, "qoif", 4);
+			p = putBE32(putBE32(p + 4, stream->width), height);
+			*p++ = stream->nChannels;
+			*p++ = 0; // sRGB with linear alpha
+		break;
+		case blurhash_file_format_raw:
+		break;
+	}
+	return writeAll(stream->fd, header, p - header);
+}
+
+// pngBand: wraps rows of filtered scanlines into an IDAT chunk of stored deflate blocks, the zlib
+// header going into the first one and the final block and Adler-32 into the last one
+static size_t pngBand(struct outputStream *stream, const uint8_t *filtered, size_t n, bool last) {
+	uint8_t *data = stream->out + 8, *p = data;
+	if(stream->first) {
+		*p++ = 0x78; // deflate, 32 KiB window
+		*p++ = 0x01; // no dictionary, fastest
+		stream->first = false;
+	}
+	for(size_t done = 0; done < n; ) {
+		size_t block = n - done < STORED_BLOCK ? n - done : STORED_BLOCK;
+		*p++ = last && done + block == n; // BFINAL, BTYPE 00
+		p[0] = block; p[1] = block >> 8;
+		p[2] = ~block; p[3] = ~block >> 8;
+		memcpy(p + 4, filtered + done, block);
+		p += 4 + block;
+		done += block;
+	}
+	stream->adler = adler32(stream->adler, filtered, n);
+	if(last) p = putBE32(p, stream->adler);
+	return pngChunk(stream->out, "IDAT", p - data) - stream->out;
+}
+
+#define QOI_OP_INDEX 0x00
+#define QOI_OP_DIFF 0x40
+#define QOI_OP_LUMA 0x80
+#define QOI_OP_RUN 0xc0
+#define QOI_OP_RGB 0xfe
+#define QOI_OP_RGBA 0xff
+
+// qoiBand: encodes count pixels, carrying the run, the index and the previous pixel over to the next band
+static size_t qoiBand(struct outputStream *stream, const uint8_t *pixels, size_t count) {
+	uint8_t *p = stream->out, *previous = stream->previous;
+	int nChannels = stream->nChannels;
+	for(size_t k = 0; k < count; k++, pixels += nChannels) {
+		uint8_t px[4] = {pixels[0], pixels[1], pixels[2], nChannels == 4 ? pixels[3] : 255};
+		stream->pixelsLeft--;
+		if(!memcmp(px, previous, 4)) {
+			if(++stream->run == 62 || !stream->pixelsLeft) {
+				*p++ = QOI_OP_RUN | (stream->run - 1);
+				stream->run = 0;
+			}
+			continue;
+		}
+		if(stream->run) {
+			*p++ = QOI_OP_RUN | (stream->run - 1);
+			stream->run = 0;
+		}
+
+		int hash = (px[0] * 3 + px[1] * 5 + px[2] * 7 + px[3] * 11) % 64;
+		if(!memcmp(stream->index[hash], px, 4)) {
+			*p++ = QOI_OP_INDEX | hash;
+		} else if(px[3] == previous[3]) {
+			int8_t dr = px[0] - previous[0], dg = px[1] - previous[1], db = px[2] - previous[2];
+			int8_t dgr = dr - dg, dgb = db - dg;
+			if(dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1) {
+				*p++ = QOI_OP_DIFF | (dr + 2) << 4 | (dg + 2) << 2 | (db + 2);
+			} else if(dgr >= -8 && dgr <= 7 && dg >= -32 && dg <= 31 && dgb >= -8 && dgb <= 7) {
+				*p++ = QOI_OP_LUMA | (dg + 32);
+				*p++ = (dgr + 8) << 4 | (dgb + 8);
+			} else {
+				*p++ = QOI_OP_RGB;
+				*p++ = px[0]; *p++ = px[1]; *p++ = px[2];
+			}
+		} else {
+			*p++ = QOI_OP_RGBA;
+			*p++ = px[0]; *p++ = px[1]; *p++ = px[2]; *p++ = px[3];
+		}
+		memcpy(stream->index[hash], px, 4);
+		memcpy(previous, px, 4);
+	}
+	return p - stream->out;
+}
+
+// writeTrailer: writes everything of the file after the last pixel
+static blurhash_error_t writeTrailer(struct outputStream *stream) {
+	uint8_t trailer[12], *p = trailer;
+	if(stream->format == blurhash_file_format_png) {
+		p = pngChunk(p, "IEND", 0);
+	} else if(stream->format == blurhash_file_format_qoi) {
+		memset(p, 0, 7);
+		p[7] = 1;
+		p += 8;
+	}
+	return writeAll(stream->fd, trailer, p - trailer);
+}
+
+// pngSink: the stbi_write_png_to_func context of writeCompressedPNG
+struct pngSink {
+	int fd;
+	blurhash_error_t err;
+};
+
+static void pngSinkWrite(void *context, void *data, int size) {
+	struct pngSink *sink = (struct pngSink *)context;
+	if(!sink->err) sink->err = writeAll(sink->fd, data, size);
+}
+
+// pngLevelLock guards stbi_write_png_compression_level, which stb_image_write keeps in a global
+static pthread_mutex_t pngLevelLock = PTHREAD_MUTEX_INITIALIZER;
+
+static blurhash_error_t writeCompressedPNG(int fd, int width, int height, int nChannels, int pngLevel, const uint8_t *pixels) {
+	struct pngSink sink = {fd, blurhash_error_ok};
+	pthread_mutex_lock(&pngLevelLock);
+	int level = stbi_write_png_compression_level;
+	stbi_write_png_compression_level = pngLevel;
+	int ok = stbi_write_png_to_func(pngSinkWrite, &sink, width, height, nChannels, pixels, width * nChannels);
+	stbi_write_png_compression_level = level;
+	pthread_mutex_unlock(&pngLevelLock);
+	if(sink.err) return sink.err;
+	return ok ? blurhash_error_ok : blurhash_error_stbi_write_png;
+}
+
+// checkOutput: validates every argument and parses blurhash before anything is written, nChannels is fixed for PPM
+static blurhash_error_t checkOutput(const char* blurhash, int width, int height, int punch, int *nChannels, blurhash_file_format_t format, int pngLevel, blurhash_coeffs_t *coeffs) {
+	if(format == blurhash_file_format_ppm) *nChannels = 3;
+	if((unsigned)format > blurhash_file_format_qoi || (*nChannels != 3 && *nChannels != 4) || pngLevel < 0 || pngLevel > 9) {
+		errno = EINVAL;
+		return blurhash_error_invalid_format;
+	}
+	if(width <= 0 || height <= 0) {
+		errno = EINVAL;
+		return blurhash_error_invalid_rect;
+	}
+	return blurhash_parse(blurhash, punch, coeffs);
+}
+
+// writeImage: renders the checked coeffs band by band into fd and ends the stats of start
+static blurhash_error_t writeImage(uint64_t start, const blurhash_coeffs_t *coeffs, int width, int height, int nChannels, blurhash_file_format_t format, int pngLevel, int fd) {
+	blurhash_error_t err = blurhash_error_ok;
+	int numX = coeffs->numX, numY = coeffs->numY;
+
+	// streamed PNG scanlines are rendered behind their filter byte, which calloc leaves at 0 (none)
+	bool png = format == blurhash_file_format_png, compressed = png && pngLevel;
+	size_t rowBytes = (size_t)width * nChannels, stride = rowBytes + (png && !compressed);
+	int bandRows = compressed ? height : (int)(BAND_BYTES / stride);
+	if(bandRows < 1) bandRows = 1;
+	if(bandRows > height) bandRows = height;
+	size_t bandBytes = stride * bandRows, outSize = 0;
+	if(format == blurhash_file_format_qoi) outSize = (size_t)width * bandRows * (nChannels + 2);
+	else if(png && !compressed) outSize = bandBytes + 5 * (bandBytes / STORED_BLOCK + 1) + 18;
+
+	float *scratch = malloc(sizeof(float) * (numX * width + numY * height + 3 * width));
+	uint8_t *pixels = calloc(bandBytes, 1), *out = outSize ? malloc(outSize) : NULL;
+	if(!scratch || !pixels || (outSize && !out)) {
+		free(scratch); free(pixels); free(out);
+		return blurhash_stats_end(start, 0, 0, blurhash_error_malloc);
+	}
+	float *cosX = scratch, *cosY = cosX + numX * width, *linear = cosY + numY * height;
+	blurhash_fillBasisTable(numX, width, cosX);
+	blurhash_fillBasisTable(numY, height, cosY);
+
+	struct outputStream stream = {
+		.fd = fd, .format = format, .width = width, .nChannels = nChannels, .out = out,
+		.adler = 1, .first = true, .previous = {0, 0, 0, 255}, .pixelsLeft = (uint64_t)width * height
+	};
+	uint64_t write = blurhash_stats_clock();
+	if(!compressed) err = writeHeader(&stream, height);
+	blurhash_stats_stage(blurhash_stats_stage_write, write);
+
+	for(int y = 0; !err && y < height; y += bandRows) {
+		int rows = height - y < bandRows ? height - y : bandRows;
+		uint64_t render = blurhash_stats_clock();
+		blurhash_render_rows(numX, numY, coeffs->colors[0], width, rows, cosX, cosY + y, height, nChannels, stride, linear, pixels + stride - rowBytes);
+		blurhash_stats_stage(blurhash_stats_stage_render, render);
+
+		write = blurhash_stats_clock();
+		if(compressed) err = writeCompressedPNG(fd, width, height, nChannels, pngLevel, pixels);
+		else if(png) err = writeAll(fd, out, pngBand(&stream, pixels, stride * rows, y + rows == height));
+		else if(format == blurhash_file_format_qoi) err = writeAll(fd, out, qoiBand(&stream, pixels, (size_t)width * rows));
+		else err = writeAll(fd, pixels, rowBytes * rows);
+		blurhash_stats_stage(blurhash_stats_stage_write, write);
+	}
+
+	write = blurhash_stats_clock();
+	if(!err && !compressed) err = writeTrailer(&stream);
+	blurhash_stats_stage(blurhash_stats_stage_write, write);
+
+	free(scratch); free(pixels); free(out);
+
+	return blurhash_stats_end(start, (uint64_t)width * height, (uint64_t)rowBytes * height, err);
+}
+
+blurhash_error_t blurhash_decode_fd(const char* blurhash, int width, int height, int punch, int nChannels, blurhash_file_format_t format, int pngLevel, int fd) {
+	uint64_t start = blurhash_stats_begin(blurhash_stats_op_decode);
+	blurhash_coeffs_t coeffs;
+	blurhash_error_t err = checkOutput(blurhash, width, height, punch, &nChannels, format, pngLevel, &coeffs);
+	if(err) return blurhash_stats_end(start, 0, 0, err);
+
+	return writeImage(start, &coeffs, width, height, nChannels, format, pngLevel, fd);
+}
+
+blurhash_error_t blurhash_decode_file_ex(const char* blurhash, int width, int height, int punch, int nChannels, blurhash_file_format_t format, int pngLevel, const char *filename) {
+	uint64_t start = blurhash_stats_begin(blurhash_stats_op_decode);
+	// a bad hash or argument must leave an existing filename untouched, so nothing is opened before the checks
+	blurhash_coeffs_t coeffs;
+	blurhash_error_t err = checkOutput(blurhash, width, height, punch, &nChannels, format, pngLevel, &coeffs);
+	if(err) return blurhash_stats_end(start, 0, 0, err);
+
+	int fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+	if(fd < 0) return blurhash_stats_end(start, 0, 0, blurhash_error_write);
+
+	err = writeImage(start, &coeffs, width, height, nChannels, format, pngLevel, fd);
+	if(close(fd) && !err) err = blurhash_error_write;
+	return err;
+}
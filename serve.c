@@ -0,0 +1,535 @@
+/* serve.c
+ * This file is part of the blurhash distribution (https://github.com/fumiama/blurhash).
+ * Copyright (c) 2018 Wolt Enterprises and Copyright (c) 2025 Fumiama Minamoto.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "blurhash.h"
+#include "serve.h"
+
+static inline uint32_t get_be32(const uint8_t *p) {
+	return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+static inline uint8_t *put_be32(uint8_t *p, uint32_t v) {
+	p[0] = v >> 24; p[1] = v >> 16; p[2] = v >> 8; p[3] = v;
+	return p + 4;
+}
+
+// write_all: writes n bytes to fd, retrying short and interrupted writes
+static bool write_all(int fd, const void *data, size_t n) {
+	const uint8_t *p = (const uint8_t *)data;
+	while(n) {
+		ssize_t written = write(fd, p, n);
+		if(written < 0 && errno == EINTR) continue;
+		if(written <= 0) return false;
+		p += written;
+		n -= written;
+	}
+	return true;
+}
+
+// byte_buffer: grows to the largest size it was asked for and is kept for the next use
+struct byte_buffer {
+	uint8_t *data;
+	size_t len, cap;
+};
+
+static bool buffer_reserve(struct byte_buffer *buffer, size_t cap) {
+	if(cap <= buffer->cap) return true;
+	if(cap < 2 * buffer->cap) cap = 2 * buffer->cap;
+	uint8_t *p = realloc(buffer->data, cap);
+	if(!p) return false;
+	buffer->data = p;
+	buffer->cap = cap;
+	return true;
+}
+
+// read_frame: reads the next frame of fd into in, behind any bytes consumed before start, which are dropped.
+// The frame is at in->data + *start, *len bytes long; false on end of stream, error or an oversized frame.
+static bool read_frame(int fd, struct byte_buffer *in, size_t *start, size_t *len, size_t max) {
+	size_t need = 4;
+	for(bool header = true;; ) {
+		if(in->len - *start >= need) {
+			if(!header) return true;
+			*len = get_be32(in->data + *start);
+			if(*len > max) return false;
+			*start += 4;
+			need = *len;
+			header = false;
+			continue;
+		}
+		if(*start) {
+			memmove(in->data, in->data + *start, in->len - *start);
+			in->len -= *start;
+			*start = 0;
+		}
+		if(!buffer_reserve(in, need < 64 * 1024 ? 64 * 1024 : need)) return false;
+		ssize_t got = read(fd, in->data + in->len, in->cap - in->len);
+		if(got < 0 && errno == EINTR) continue;
+		if(got <= 0) return false;
+		in->len += got;
+	}
+}
+
+// serve_stopping: set once SIGINT or SIGTERM has arrived, no connection is taken after it
+static atomic_bool serve_stopping;
+
+// serve_worker: one thread of the fixed pool, its buffers are reused by every request it serves
+struct serve_worker {
+	int listen_fd;
+	pthread_mutex_t lock; // guards conn against serve_main shutting it down while it is closed
+	int conn; // the connection being served, -1 if none
+	int image_fd; // memfd the decoded images are written to before they are sent
+	struct byte_buffer in, out;
+	char path[4096];
+};
+
+// respond_header: appends the header of a response with n bytes of payload to out
+static bool respond_header(struct byte_buffer *out, uint32_t id, blurhash_error_t err, size_t n) {
+	if(!buffer_reserve(out, out->len + 9)) return false;
+	uint8_t *p = put_be32(out->data + out->len, 5 + n);
+	p = put_be32(p, id);
+	*p = err;
+	out->len += 9;
+	return true;
+}
+
+// respond: appends a whole response to out
+static bool respond(struct byte_buffer *out, uint32_t id, blurhash_error_t err, const void *payload, size_t n) {
+	if(!buffer_reserve(out, out->len + 9 + n) || !respond_header(out, id, err, n)) return false;
+	if(n) memcpy(out->data + out->len, payload, n);
+	out->len += n;
+	return true;
+}
+
+static bool flush(int fd, struct byte_buffer *out) {
+	bool ok = write_all(fd, out->data, out->len);
+	out->len = 0;
+	return ok;
+}
+
+// serve_decode: decodes into the memfd of the worker, then sends it after the response header
+static bool serve_decode(struct serve_worker *worker, int conn, uint32_t id, const uint8_t *request, size_t n) {
+	if(n < 12) return respond(&worker->out, id, blurhash_error_invalid_hash, NULL, 0);
+
+	int width = (int)get_be32(request), height = (int)get_be32(request + 4);
+	int punch = request[8], channels = request[9], format = request[10], level = request[11];
+	char hash[BLURHASH_ENCODE_BUFSZ];
+	size_t hash_len = n - 12;
+	if(hash_len > sizeof(hash) - 1) {
+		errno = EINVAL;
+		return respond(&worker->out, id, blurhash_error_invalid_hash, NULL, 0);
+	}
+	memcpy(hash, request + 12, hash_len);
+	hash[hash_len] = 0;
+
+	blurhash_error_t err = blurhash_error_ok;
+	if(width <= 0 || height <= 0 || (uint64_t)width * height * (channels < 3 ? 3 : channels) > SERVE_MAX_FRAME) {
+		errno = EINVAL;
+		err = blurhash_error_invalid_rect;
+	}
+	if(!err && lseek(worker->image_fd, 0, SEEK_SET) < 0) err = blurhash_error_write;
+	if(!err) err = blurhash_decode_fd(hash, width, height, punch, channels, (blurhash_file_format_t)format, level, worker->image_fd);
+	if(err) return respond(&worker->out, id, err, NULL, 0);
+
+	// the memfd keeps its largest size, only the bytes of this image are sent. The pixels fit into a frame,
+	// but a header or the PNG and QOI overhead may not, and a client rejects a frame larger than SERVE_MAX_FRAME
+	off_t size = lseek(worker->image_fd, 0, SEEK_CUR), offset = 0;
+	if(size < 0) return respond(&worker->out, id, blurhash_error_write, NULL, 0);
+	if((uint64_t)size + 5 > SERVE_MAX_FRAME) {
+		errno = EINVAL;
+		return respond(&worker->out, id, blurhash_error_invalid_rect, NULL, 0);
+	}
+	if(!respond_header(&worker->out, id, err, size) || !flush(conn, &worker->out)) return false;
+	while(offset < size) {
+		ssize_t sent = sendfile(conn, worker->image_fd, &offset, size - offset);
+		if(sent < 0 && errno == EINTR) continue;
+		if(sent <= 0) return false;
+	}
+	return true;
+}
+
+// serve_request: handles one request frame, false if the connection should be closed
+static bool serve_request(struct serve_worker *worker, int conn, const uint8_t *frame, size_t n) {
+	if(n < 5) return false;
+	uint8_t op = frame[0];
+	uint32_t id = get_be32(frame + 1);
+	const uint8_t *request = frame + 5;
+	n -= 5;
+
+	char hash[BLURHASH_ENCODE_BUFSZ];
+	blurhash_error_t err;
+	switch(op) {
+		case 'e':
+		case 'f':
+			if(n < 2) {
+				errno = EINVAL;
+				return respond(&worker->out, id, blurhash_error_stbi_load, NULL, 0);
+			}
+			if(op == 'e') {
+				err = blurhash_encode_memory(request[0], request[1], request + 2, n - 2, hash);
+			} else {
+				if(n - 2 >= sizeof(worker->path)) {
+					errno = ENAMETOOLONG;
+					return respond(&worker->out, id, blurhash_error_stbi_load, NULL, 0);
+				}
+				memcpy(worker->path, request + 2, n - 2);
+				worker->path[n - 2] = 0;
+				err = blurhash_encode_file(request[0], request[1], worker->path, hash);
+			}
+			return respond(&worker->out, id, err, hash, err ? 0 : strlen(hash));
+		case 'd':
+			return serve_decode(worker, conn, id, request, n);
+		default:
+			errno = EINVAL;
+			return respond(&worker->out, id, blurhash_error_invalid_format, NULL, 0);
+	}
+}
+
+// serve_connection: serves the requests of conn until it is closed, replies are
+// sent once every request already received has been handled
+static void serve_connection(struct serve_worker *worker, int conn) {
+	size_t start = 0, len;
+	worker->in.len = worker->out.len = 0;
+	while(read_frame(conn, &worker->in, &start, &len, SERVE_MAX_FRAME)) {
+		bool ok = serve_request(worker, conn, worker->in.data + start, len);
+		start += len;
+		if(!ok) break;
+		if(worker->in.len - start < 4 || worker->in.len - start < 4 + get_be32(worker->in.data + start)) {
+			if(!flush(conn, &worker->out)) break;
+		}
+	}
+	flush(conn, &worker->out);
+}
+
+static void *serve_worker_thread(void *arg) {
+	struct serve_worker *worker = (struct serve_worker *)arg;
+	while(!atomic_load(&serve_stopping)) {
+		int conn = accept(worker->listen_fd, NULL, NULL);
+		if(conn < 0) {
+			if(errno == EINVAL || errno == EBADF) break; // the listening socket was shut down
+			if(errno == EMFILE || errno == ENFILE || errno == ENOBUFS || errno == ENOMEM) usleep(10000);
+			continue;
+		}
+		pthread_mutex_lock(&worker->lock);
+		worker->conn = conn;
+		// a stop that came after the accept did not see this connection, so no more requests are read from it
+		if(atomic_load(&serve_stopping)) shutdown(conn, SHUT_RD);
+		pthread_mutex_unlock(&worker->lock);
+
+		serve_connection(worker, conn);
+
+		pthread_mutex_lock(&worker->lock);
+		worker->conn = -1;
+		close(conn);
+		pthread_mutex_unlock(&worker->lock);
+	}
+	return NULL;
+}
+
+int serve_main(int argc, const char **argv) {
+	const char *socket_path = NULL;
+	int nthreads = 0;
+	for(int i = 0; i < argc; i++) {
+		if(!strcmp(argv[i], "--socket") && i + 1 < argc) socket_path = argv[++i];
+		else if(!strcmp(argv[i], "-j") && i + 1 < argc) nthreads = atoi(argv[++i]);
+		else socket_path = NULL, i = argc;
+	}
+	struct sockaddr_un addr = {.sun_family = AF_UNIX};
+	if(!socket_path || strlen(socket_path) >= sizeof(addr.sun_path)) {
+		fputs("blurhash serve --socket PATH [-j threads]\n", stderr);
+		return -1;
+	}
+	strcpy(addr.sun_path, socket_path);
+	if(nthreads <= 0) nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+	if(nthreads < 1) nthreads = 1;
+
+	// a socket left behind by an earlier server is replaced, any other file is not
+	struct stat st;
+	if(lstat(socket_path, &st) == 0 && S_ISSOCK(st.st_mode)) unlink(socket_path);
+	int listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if(listen_fd < 0 || bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)) || listen(listen_fd, SOMAXCONN)) {
+		perror(socket_path);
+		return -1;
+	}
+
+	// SIGINT and SIGTERM are taken by sigwait on this thread only, the workers inherit the mask
+	sigset_t signals;
+	sigemptyset(&signals);
+	sigaddset(&signals, SIGINT);
+	sigaddset(&signals, SIGTERM);
+	pthread_sigmask(SIG_BLOCK, &signals, NULL);
+	signal(SIGPIPE, SIG_IGN);
+
+	struct serve_worker *workers = calloc(nthreads, sizeof(struct serve_worker));
+	pthread_t *threads = malloc(sizeof(pthread_t) * nthreads);
+	if(!workers || !threads) {
+		perror("blurhash serve");
+		return -1;
+	}
+	for(int i = 0; i < nthreads; i++) {
+		workers[i].listen_fd = listen_fd;
+		workers[i].conn = -1;
+		pthread_mutex_init(&workers[i].lock, NULL);
+		workers[i].image_fd = memfd_create("blurhash", MFD_CLOEXEC);
+		if(workers[i].image_fd < 0) {
+			perror("memfd_create");
+			return -1;
+		}
+	}
+	int started = 0;
+	while(started < nthreads && pthread_create(&threads[started], NULL, serve_worker_thread, &workers[started]) == 0) started++;
+	if(!started) {
+		perror("pthread_create");
+		return -1;
+	}
+
+	int sig;
+	while(sigwait(&signals, &sig));
+
+	// no new connections, and no new requests on the open ones; the requests already
+	// received are answered before the workers return
+	atomic_store(&serve_stopping, true);
+	shutdown(listen_fd, SHUT_RDWR);
+	for(int i = 0; i < started; i++) {
+		pthread_mutex_lock(&workers[i].lock);
+		if(workers[i].conn >= 0) shutdown(workers[i].conn, SHUT_RD);
+		pthread_mutex_unlock(&workers[i].lock);
+	}
+	for(int i = 0; i < started; i++) pthread_join(threads[i], NULL);
+
+	unlink(socket_path);
+	close(listen_fd);
+	for(int i = 0; i < nthreads; i++) {
+		close(workers[i].image_fd);
+		free(workers[i].in.data);
+		free(workers[i].out.data);
+		pthread_mutex_destroy(&workers[i].lock);
+	}
+	free(workers);
+	free(threads);
+	return 0;
+}
+
+// client_request: one line of client input
+struct client_request {
+	char *text; // the line, split into fields
+	const char *line; // label of the result, the path or output file
+	uint8_t *frame;
+	size_t frame_len;
+	const char *output; // decode result file, NULL for encodes
+	const char *error; // set if the line could not be sent
+};
+
+// client_parse: turns `e|f\tx\ty\tpath` or `d\thash\twidth\theight\toutput[\tpunch]` into a request frame
+static void client_parse(struct client_request *request, uint32_t id) {
+	char *fields[6] = {request->text};
+	int n = 1;
+	request->line = request->text;
+	for(char *p = request->text; *p && n < 6; p++) {
+		if(*p == '\t') {
+			*p = 0;
+			fields[n++] = p + 1;
+		}
+	}
+	const char *op = fields[0];
+	if((!strcmp(op, "e") || !strcmp(op, "f")) && n == 4) {
+		request->line = fields[3];
+		uint8_t *data = NULL;
+		size_t size = strlen(fields[3]);
+		if(op[0] == 'e') {
+			FILE *fp = fopen(fields[3], "rb");
+			long end = -1;
+			if(fp && !fseek(fp, 0, SEEK_END) && (end = ftell(fp)) >= 0 && (data = malloc(end ? end : 1))) {
+				rewind(fp);
+				if(fread(data, 1, end, fp) != (size_t)end) end = -1;
+			}
+			if(fp) fclose(fp);
+			if(end < 0) {
+				free(data);
+				request->error = "blurhash_error_stbi_load";
+				return;
+			}
+			size = end;
+		}
+		request->frame_len = 4 + 5 + 2 + size;
+		request->frame = malloc(request->frame_len);
+		if(!request->frame) {
+			free(data);
+			request->error = "blurhash_error_malloc";
+			return;
+		}
+		uint8_t *p = put_be32(request->frame, request->frame_len - 4);
+		*p++ = op[0];
+		p = put_be32(p, id);
+		*p++ = atoi(fields[1]);
+		*p++ = atoi(fields[2]);
+		memcpy(p, data ? (const void *)data : (const void *)fields[3], size);
+		free(data);
+	} else if(!strcmp(op, "d") && n >= 5) {
+		request->line = request->output = fields[4];
+		size_t hash_len = strlen(fields[1]);
+		request->frame_len = 4 + 5 + 12 + hash_len;
+		request->frame = malloc(request->frame_len);
+		if(!request->frame) {
+			request->error = "blurhash_error_malloc";
+			return;
+		}
+		uint8_t *p = put_be32(request->frame, request->frame_len - 4);
+		*p++ = 'd';
+		p = put_be32(p, id);
+		p = put_be32(p, atoi(fields[2]));
+		p = put_be32(p, atoi(fields[3]));
+		*p++ = n == 6 ? atoi(fields[5]) : 1;
+		*p++ = 4;
+		*p++ = blurhash_output_format(fields[4]);
+		*p++ = BLURHASH_PNG_LEVEL_DEFAULT;
+		memcpy(p, fields[1], hash_len);
+	} else {
+		request->error = "invalid request";
+	}
+}
+
+struct client_state {
+	int fd;
+	struct client_request *requests;
+	size_t n;
+};
+
+// client_send: sends every request while the main thread reads the responses
+static void *client_send(void *arg) {
+	struct client_state *state = (struct client_state *)arg;
+	for(size_t i = 0; i < state->n; i++) {
+		struct client_request *request = &state->requests[i];
+		if(!request->error && !write_all(state->fd, request->frame, request->frame_len)) break;
+	}
+	shutdown(state->fd, SHUT_WR);
+	return NULL;
+}
+
+int client_main(int argc, const char **argv) {
+	struct sockaddr_un addr = {.sun_family = AF_UNIX};
+	if(argc != 2 || strcmp(argv[0], "--socket") || strlen(argv[1]) >= sizeof(addr.sun_path)) {
+		fputs("blurhash client --socket PATH\n", stderr);
+		return -1;
+	}
+	strcpy(addr.sun_path, argv[1]);
+	signal(SIGPIPE, SIG_IGN);
+
+	// every line of stdin is read and encoded up front, then all of them are pipelined
+	struct client_state state = {-1, NULL, 0};
+	size_t cap = 0;
+	char *line = NULL;
+	size_t line_cap = 0;
+	ssize_t len;
+	while((len = getline(&line, &line_cap, stdin)) >= 0) {
+		if(len > 0 && line[len - 1] == '\n') line[--len] = 0;
+		if(!len) continue;
+		if(state.n == cap) {
+			cap = cap ? 2 * cap : 64;
+			struct client_request *p = realloc(state.requests, cap * sizeof(struct client_request));
+			if(!p) {
+				perror("blurhash client");
+				return -1;
+			}
+			state.requests = p;
+		}
+		struct client_request *request = &state.requests[state.n];
+		memset(request, 0, sizeof(*request));
+		request->line = request->text = strdup(line);
+		if(request->text) client_parse(request, (uint32_t)state.n);
+		else request->line = "", request->error = "blurhash_error_malloc";
+		state.n++;
+	}
+	free(line);
+
+	state.fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if(state.fd < 0 || connect(state.fd, (struct sockaddr *)&addr, sizeof(addr))) {
+		perror(argv[1]);
+		return -1;
+	}
+	pthread_t sender;
+	if(pthread_create(&sender, NULL, client_send, &state)) {
+		perror("pthread_create");
+		return -1;
+	}
+
+	// once the connection is lost, every request still unanswered gets an error line
+	int failed = 0;
+	bool lost = false;
+	struct byte_buffer in = {NULL, 0, 0};
+	size_t start = 0, frame_len;
+	for(size_t i = 0; i < state.n; i++) {
+		struct client_request *request = &state.requests[i];
+		const char *result = request->error;
+		char hash[BLURHASH_ENCODE_BUFSZ];
+		if(!result && !lost && (!read_frame(state.fd, &in, &start, &frame_len, SERVE_MAX_FRAME) || frame_len < 5 || get_be32(in.data + start) != i)) {
+			fprintf(stderr, "blurhash client: connection lost\n");
+			lost = true;
+		}
+		if(!result && lost) {
+			result = "connection lost";
+		} else if(!result) {
+			const uint8_t *response = in.data + start;
+			blurhash_error_t err = (blurhash_error_t)response[4];
+			start += frame_len;
+			if(err) {
+				result = blurhash_strerror(err);
+			} else if(request->output) {
+				FILE *fp = fopen(request->output, "wb");
+				bool ok = fp && fwrite(response + 5, 1, frame_len - 5, fp) == frame_len - 5;
+				if(fp && fclose(fp)) ok = false;
+				result = ok ? "ok" : "blurhash_error_write";
+			} else {
+				size_t hash_len = frame_len - 5 < sizeof(hash) - 1 ? frame_len - 5 : sizeof(hash) - 1;
+				memcpy(hash, response + 5, hash_len);
+				hash[hash_len] = 0;
+				result = hash;
+			}
+		}
+		if(result != hash && strcmp(result, "ok")) failed++;
+		printf("%s\t%s\n", request->line, result);
+	}
+
+	pthread_join(sender, NULL);
+	close(state.fd);
+	free(in.data);
+	for(size_t i = 0; i < state.n; i++) {
+		free(state.requests[i].text);
+		free(state.requests[i].frame);
+	}
+	free(state.requests);
+	return failed ? 1 : 0;
+}
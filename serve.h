@@ -0,0 +1,55 @@
+/* serve.h
+ * This file is part of the blurhash distribution (https://github.com/fumiama/blurhash).
+ * Copyright (c) 2018 Wolt Enterprises and Copyright (c) 2025 Fumiama Minamoto.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __BLURHASH_SERVE_H__
+#define __BLURHASH_SERVE_H__
+
+#include "blurhash.h"
+
+// The protocol of `blurhash serve`: every message is a frame of a 4-byte big-endian length,
+// counting the bytes that follow it, then the message itself. Integers are big-endian.
+//
+// request:  u8 op, u32 id, then by op
+//   'e' encode image bytes:  u8 x_components, u8 y_components, the bytes of an image file
+//   'f' encode a file path:  u8 x_components, u8 y_components, the path, read by the server
+//   'd' decode:              u32 width, u32 height, u8 punch, u8 channels, u8 blurhash_file_format_t,
+//                            u8 png level, the hash
+// response: u32 id of the request, u8 blurhash_error_t, then the hash or the image file on success
+//
+// Requests may be pipelined, the responses of a connection come in the order of its requests.
+
+// SERVE_MAX_FRAME is the largest frame either way: a decode whose pixels or image file, with the
+// response header, exceed it is answered with blurhash_error_invalid_rect
+#define SERVE_MAX_FRAME (64 << 20)
+
+// serve_main: `blurhash serve --socket PATH [-j N]`, argv after `serve`
+int serve_main(int argc, const char **argv);
+
+// client_main: `blurhash client --socket PATH`, argv after `client`
+int client_main(int argc, const char **argv);
+
+// blurhash_output_format: picks the file format by the extension of filename, PNG if none matches,
+// shared by blurhash.c and the client in serve.c; this header is private to the blurhash tool and not installed
+blurhash_file_format_t blurhash_output_format(const char *filename);
+
+#endif
@@ -0,0 +1,64 @@
+#!/bin/sh
+# serve_test.sh
+# This file is part of the blurhash distribution (https://github.com/fumiama/blurhash).
+# Copyright (c) 2025 Fumiama Minamoto.
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"), to deal
+# in the Software without restriction, including without limitation the rights
+# to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+# copies of the Software, and to permit persons to whom the Software is
+# furnished to do so, subject to the following conditions:
+
+# The above copyright notice and this permission notice shall be included in all
+# copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+# AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+# OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+# SOFTWARE.
+#
+
+# serve_test.sh BLURHASH: starts `BLURHASH serve` and checks the lines `BLURHASH client` prints for it,
+# including a decode whose pixels fit into a frame but whose PAM file does not
+
+BLURHASH=$1
+HASH='LEHV6nWB2yk8pyo0adR*.7kCMdnj'
+DIR=$(mktemp -d) || exit 1
+SERVER=
+trap '[ -n "$SERVER" ] && kill $SERVER 2>/dev/null; rm -rf "$DIR"' EXIT
+cd "$DIR" || exit 1
+
+fail() {
+	echo "serve_test: $*" >&2
+	exit 1
+}
+
+"$BLURHASH" d "$HASH" 32 24 local.ppm || fail "blurhash d"
+ENCODED=$("$BLURHASH" e 4 3 local.ppm) || fail "blurhash e"
+
+"$BLURHASH" serve --socket serve.sock -j 2 &
+SERVER=$!
+for i in 1 2 3 4 5 6 7 8 9 10; do
+	[ -S serve.sock ] && break
+	sleep 0.2
+done
+[ -S serve.sock ] || fail "the server did not create its socket"
+
+printf 'd\t%s\t32\t24\tserved.ppm\nd\t%s\t4096\t4096\tbig.pam\ne\t4\t3\tlocal.ppm\nf\t4\t3\t%s/local.ppm\nd\tbad\t3\t3\tbad.png\nbogus\n' \
+	"$HASH" "$HASH" "$DIR" | "$BLURHASH" client --socket serve.sock > got.txt
+[ $? -eq 1 ] || fail "the client should fail for the bad requests"
+printf 'served.ppm\tok\nbig.pam\tblurhash_error_invalid_rect\nlocal.ppm\t%s\n%s/local.ppm\t%s\nbad.png\tblurhash_error_invalid_hash\nbogus\tinvalid request\n' \
+	"$ENCODED" "$DIR" "$ENCODED" > want.txt
+cmp -s got.txt want.txt || { diff want.txt got.txt >&2; fail "unexpected client output"; }
+cmp -s served.ppm local.ppm || fail "the served image differs from blurhash d"
+[ -e big.pam ] && fail "the rejected decode wrote big.pam"
+
+kill -TERM $SERVER
+wait $SERVER || fail "the server did not exit cleanly"
+SERVER=
+[ -e serve.sock ] && fail "the server left its socket behind"
+exit 0
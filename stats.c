@@ -0,0 +1,129 @@
+/* stats.c
+ * This file is part of the blurhash distribution (https://github.com/fumiama/blurhash).
+ * Copyright (c) 2018 Wolt Enterprises and Copyright (c) 2025 Fumiama Minamoto.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stddef.h>
+#include <time.h>
+
+#include "blurhash.h"
+#include "common.h"
+
+#ifndef BLURHASH_NO_STATS
+
+atomic_bool blurhash_stats_enabled;
+
+// totals: the process-wide counters, laid out as the uint64_t fields of blurhash_stats_t
+static _Atomic uint64_t totals[sizeof(blurhash_stats_t) / sizeof(uint64_t)];
+#define TOTAL(field) (&totals[offsetof(blurhash_stats_t, field) / sizeof(uint64_t)])
+
+// callState: the call in progress on this thread, depth counting nested entry points
+static _Thread_local struct {
+	int depth;
+	bool hasLast;
+	blurhash_call_stats_t current, last;
+} callState;
+
+uint64_t blurhash_stats_now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec + 1;
+}
+
+uint64_t blurhash_stats_enter(blurhash_stats_op_t op) {
+	if(!callState.depth++) {
+		memset(&callState.current, 0, sizeof(callState.current));
+		callState.current.op = op;
+	}
+	return blurhash_stats_now();
+}
+
+void blurhash_stats_add(blurhash_stats_stage_t stage, uint64_t ns) {
+	callState.current.stageNs[stage] += ns;
+}
+
+void blurhash_stats_leave(uint64_t start, uint64_t pixels, uint64_t bytes, blurhash_error_t err) {
+	if(--callState.depth) return;
+
+	blurhash_call_stats_t *call = &callState.current;
+	call->err = err;
+	call->pixels = pixels;
+	call->bytes = bytes;
+	call->ns = blurhash_stats_now() - start;
+
+	blurhash_stats_op_t op = call->op;
+	atomic_fetch_add_explicit(TOTAL(calls) + op, 1, memory_order_relaxed);
+	if(err) atomic_fetch_add_explicit(TOTAL(errors) + op, 1, memory_order_relaxed);
+	atomic_fetch_add_explicit(TOTAL(pixels) + op, pixels, memory_order_relaxed);
+	atomic_fetch_add_explicit(TOTAL(bytes) + op, bytes, memory_order_relaxed);
+	atomic_fetch_add_explicit(TOTAL(ns) + op, call->ns, memory_order_relaxed);
+	for(int s = 0; s < blurhash_stats_stage_count; s++) {
+		if(call->stageNs[s]) atomic_fetch_add_explicit(TOTAL(stageNs) + s, call->stageNs[s], memory_order_relaxed);
+	}
+	int bucket = 63 - __builtin_clzll(call->ns | 1);
+	if(bucket >= BLURHASH_STATS_BUCKETS) bucket = BLURHASH_STATS_BUCKETS - 1;
+	atomic_fetch_add_explicit(TOTAL(histogram) + op * BLURHASH_STATS_BUCKETS + bucket, 1, memory_order_relaxed);
+
+	callState.last = *call;
+	callState.hasLast = true;
+}
+
+void blurhash_stats_enable(bool enable) {
+	atomic_store(&blurhash_stats_enabled, enable);
+}
+
+void blurhash_stats_get(blurhash_stats_t *stats) {
+	uint64_t *fields = (uint64_t *)stats;
+	for(size_t i = 0; i < sizeof(totals) / sizeof(totals[0]); i++) {
+		fields[i] = atomic_load_explicit(&totals[i], memory_order_relaxed);
+	}
+}
+
+void blurhash_stats_reset(void) {
+	for(size_t i = 0; i < sizeof(totals) / sizeof(totals[0]); i++) {
+		atomic_store_explicit(&totals[i], 0, memory_order_relaxed);
+	}
+}
+
+bool blurhash_stats_last_call(blurhash_call_stats_t *stats) {
+	if(callState.hasLast) *stats = callState.last;
+	return callState.hasLast;
+}
+
+#else
+
+void blurhash_stats_enable(bool enable) {
+	(void)enable;
+}
+
+void blurhash_stats_get(blurhash_stats_t *stats) {
+	memset(stats, 0, sizeof(blurhash_stats_t));
+}
+
+void blurhash_stats_reset(void) {
+}
+
+bool blurhash_stats_last_call(blurhash_call_stats_t *stats) {
+	(void)stats;
+	return false;
+}
+
+#endif